@@ -0,0 +1,33 @@
+#ifndef __INCLUDE_GUARD_AGENT_BATCHMCTS_HPP
+#define __INCLUDE_GUARD_AGENT_BATCHMCTS_HPP
+
+#include "agent_Mcts.hpp"
+#include "engine_GameStateBatch.hpp"
+
+namespace agent {
+
+/**
+ * Mcts that scores each leaf with the mean of kLanes lockstep rollouts.
+ */
+template <size_t kLanes = 8>
+class BatchMcts : public Mcts {
+ public:
+  using Mcts::Mcts;
+
+  float Heuristic(GameState const& gs) override {
+    engine::GameStateBatch<kLanes> batch(gs, GetArid());
+    batch.Rollout([&]() { return Rand(); });
+
+    float score = 0.0f;
+    for (size_t l = 0; l < kLanes; ++l) {
+      score += Score(batch.GetScore(l, 0) + batch.GetSun(l, 0) / 3,
+                     batch.GetScore(l, 1) + batch.GetSun(l, 1) / 3);
+    }
+
+    return score / kLanes;
+  }
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_BATCHMCTS_HPP */
@@ -0,0 +1,279 @@
+#ifndef __INCLUDE_GUARD_AGENT_CHILDSTATS_HPP
+#define __INCLUDE_GUARD_AGENT_CHILDSTATS_HPP
+
+#include <pthread.h>
+
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "util_General.hpp"
+
+namespace agent {
+
+/**
+ * Search statistics of every node's children as parallel arrays: visits,
+ * scores and child node indices. The children of a node take a contiguous,
+ * kLanes aligned block of slots, slot k holding its k-th expansion, so
+ * selection scans them in whole vectors without touching the nodes.
+ *
+ * Blocks live in fixed size chunks so slots stay put while the pool grows,
+ * Allocate and Free may be called from several search threads. Freed
+ * blocks wait on a list per capacity for the next Allocate of that
+ * capacity, so a bounded number of nodes keeps the pool bounded.
+ */
+class ChildStats {
+ public:
+  static uint32_t constexpr kLanes = 8u;
+  static uint32_t constexpr kNull = 0xFFFFFFFFu;
+  static size_t constexpr kSlotBytes = 2u * sizeof(uint32_t) + sizeof(float);
+
+  ChildStats() {
+    pthread_mutex_init(&mutex_, nullptr);
+    /* Never reallocated, readers index it while Allocate appends. */
+    chunks_.reserve(kMaxChunks);
+  }
+  ~ChildStats() { pthread_mutex_destroy(&mutex_); }
+
+  ChildStats(ChildStats const&) = delete;
+  ChildStats& operator=(ChildStats const&) = delete;
+
+  /**
+   * Slots a block for n children takes.
+   */
+  static uint32_t Capacity(uint32_t n) {
+    return (n + kLanes - 1u) / kLanes * kLanes;
+  }
+
+  /**
+   * First slot of a new block with room for n children, to be cleared with
+   * ClearBlock.
+   */
+  uint32_t Allocate(uint32_t n) {
+    uint32_t capacity = Capacity(n);
+    ASSERT(capacity <= kChunkSlots);
+
+    pthread_mutex_lock(&mutex_);
+    auto& free = GetFree(capacity);
+    if (!free.empty()) {
+      uint32_t block = free.back();
+      free.pop_back();
+      pthread_mutex_unlock(&mutex_);
+      return block;
+    }
+
+    uint32_t in_chunk = size_ & kChunkMask;
+    if (in_chunk != 0u && in_chunk + capacity > kChunkSlots) {
+      size_ += kChunkSlots - in_chunk;
+    }
+    if ((size_ >> kChunkBits) == chunks_.size()) {
+      /* Growing chunks_ past its reserve would move it under readers. */
+      if (chunks_.size() >= kMaxChunks) {
+        pthread_mutex_unlock(&mutex_);
+        throw std::length_error("ChildStats: out of chunks");
+      }
+      chunks_.emplace_back(new Chunk);
+    }
+    uint32_t block = size_;
+    size_ += capacity;
+    pthread_mutex_unlock(&mutex_);
+
+    return block;
+  }
+
+  /**
+   * Returns a block of capacity slots, whose node no longer uses it.
+   */
+  void Free(uint32_t block, uint32_t capacity) {
+    pthread_mutex_lock(&mutex_);
+    GetFree(capacity).push_back(block);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void ClearBlock(uint32_t block, uint32_t capacity) {
+    for (uint32_t s = block; s < block + capacity; ++s) {
+      Visits(s) = 0u;
+      Score(s) = 0.0f;
+      Child(s) = kNull;
+    }
+  }
+
+  /**
+   * Forgets every block, keeping the chunks for reuse.
+   */
+  void Clear() {
+    size_ = 0u;
+    for (auto& free : free_) {
+      free.clear();
+    }
+  }
+
+  /* Slots handed out. */
+  size_t size() const { return size_; }
+
+  uint32_t& Visits(uint32_t slot) {
+    return GetChunk(slot).visits[slot & kChunkMask];
+  }
+  float& Score(uint32_t slot) {
+    return GetChunk(slot).scores[slot & kChunkMask];
+  }
+  uint32_t& Child(uint32_t slot) {
+    return GetChunk(slot).children[slot & kChunkMask];
+  }
+  uint32_t const& Visits(uint32_t slot) const {
+    return GetChunk(slot).visits[slot & kChunkMask];
+  }
+  float const& Score(uint32_t slot) const {
+    return GetChunk(slot).scores[slot & kChunkMask];
+  }
+  uint32_t const& Child(uint32_t slot) const {
+    return GetChunk(slot).children[slot & kChunkMask];
+  }
+
+  /**
+   * sqrt(2 ln n), the UCT exploration numerator of a node visited n times.
+   */
+  static float Exploration(uint32_t n) {
+    static auto const table = MakeExplorationTable();
+    if (n < table.size()) {
+      return table[n];
+    }
+    return std::sqrt(2.0f * std::log(static_cast<float>(n)));
+  }
+
+  /**
+   * Slot of the first n slots of block with the highest
+   * factor * score / visits + exploration / sqrt(visits), the first one on
+   * ties. Slots without visits are skipped, kNull if every slot is.
+   *
+   * Reads the slots without synchronization: other search threads may be
+   * adding to them and a lane seeing the value before or after an update is
+   * equally fine for selection.
+   */
+  __attribute__((no_sanitize("thread"))) uint32_t SelectUct(
+      uint32_t block, uint32_t n, float factor, float exploration) const {
+    Chunk const& chunk = GetChunk(block);
+    uint32_t first = block & kChunkMask;
+    uint32_t last = first + Capacity(n);
+
+    uint32_t best = kNull;
+    float best_value = -FLT_MAX;
+#ifdef __AVX2__
+    __m256 const v_factor = _mm256_set1_ps(factor);
+    __m256 const v_exploration = _mm256_set1_ps(exploration);
+    __m256 const v_lowest = _mm256_set1_ps(-FLT_MAX);
+    __m256 v_best = v_lowest;
+    __m256i v_best_slot = _mm256_set1_epi32(-1);
+    __m256i v_slot = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const v_step = _mm256_set1_epi32(kLanes);
+
+    for (uint32_t s = first; s < last; s += kLanes) {
+      __m256i visits = _mm256_load_si256(
+          reinterpret_cast<__m256i const*>(chunk.visits.data() + s));
+      __m256 n_visits = _mm256_cvtepi32_ps(visits);
+      __m256 scores = _mm256_load_ps(chunk.scores.data() + s);
+
+      __m256 rsqrt = _mm256_rsqrt_ps(n_visits);
+      __m256 inverse = _mm256_mul_ps(rsqrt, rsqrt);
+      __m256 value =
+          _mm256_fmadd_ps(_mm256_mul_ps(v_factor, scores), inverse,
+                          _mm256_mul_ps(v_exploration, rsqrt));
+      __m256 visited = _mm256_castsi256_ps(
+          _mm256_cmpgt_epi32(visits, _mm256_setzero_si256()));
+      value = _mm256_blendv_ps(v_lowest, value, visited);
+
+      __m256 better = _mm256_cmp_ps(value, v_best, _CMP_GT_OQ);
+      v_best = _mm256_blendv_ps(v_best, value, better);
+      v_best_slot = _mm256_castps_si256(
+          _mm256_blendv_ps(_mm256_castsi256_ps(v_best_slot),
+                           _mm256_castsi256_ps(v_slot), better));
+      v_slot = _mm256_add_epi32(v_slot, v_step);
+    }
+
+    alignas(32) std::array<float, kLanes> values;
+    alignas(32) std::array<int32_t, kLanes> slots;
+    _mm256_store_ps(values.data(), v_best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(slots.data()), v_best_slot);
+    for (uint32_t l = 0; l < kLanes; ++l) {
+      if (slots[l] < 0) {
+        continue;
+      }
+      uint32_t slot = block + static_cast<uint32_t>(slots[l]);
+      if (values[l] > best_value ||
+          (values[l] == best_value && slot < best)) {
+        best = slot;
+        best_value = values[l];
+      }
+    }
+#else
+    for (uint32_t s = first; s < last; ++s) {
+      uint32_t visits = chunk.visits[s];
+      if (visits == 0u) {
+        continue;
+      }
+      float rsqrt = 1.0f / std::sqrt(static_cast<float>(visits));
+      float value =
+          factor * chunk.scores[s] * rsqrt * rsqrt + exploration * rsqrt;
+      if (value > best_value) {
+        best = block + (s - first);
+        best_value = value;
+      }
+    }
+#endif
+    return best;
+  }
+
+ private:
+  static u_int constexpr kChunkBits = 14u;
+  static uint32_t constexpr kChunkSlots = 1u << kChunkBits;
+  static uint32_t constexpr kChunkMask = kChunkSlots - 1u;
+  static size_t constexpr kMaxChunks = 1u << 12;
+  static size_t constexpr kExplorationTableSize = 1u << 12;
+
+  struct Chunk {
+    alignas(32) std::array<uint32_t, kChunkSlots> visits;
+    alignas(32) std::array<float, kChunkSlots> scores;
+    std::array<uint32_t, kChunkSlots> children;
+  };
+
+  static std::vector<float> MakeExplorationTable() {
+    std::vector<float> table(kExplorationTableSize, 0.0f);
+    for (size_t n = 1; n < table.size(); ++n) {
+      table[n] = std::sqrt(2.0f * std::log(static_cast<float>(n)));
+    }
+    return table;
+  }
+
+  /**
+   * Free list of blocks of capacity, called with mutex_ held.
+   */
+  std::vector<uint32_t>& GetFree(uint32_t capacity) {
+    if (capacity / kLanes >= free_.size()) {
+      free_.resize(capacity / kLanes + 1u);
+    }
+    return free_[capacity / kLanes];
+  }
+
+  Chunk& GetChunk(uint32_t slot) { return *chunks_[slot >> kChunkBits]; }
+  Chunk const& GetChunk(uint32_t slot) const {
+    return *chunks_[slot >> kChunkBits];
+  }
+
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+  /* Freed blocks by capacity / kLanes. */
+  std::vector<std::vector<uint32_t>> free_;
+  uint32_t size_{};
+  pthread_mutex_t mutex_;
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_CHILDSTATS_HPP */
@@ -0,0 +1,245 @@
+#ifndef __INCLUDE_GUARD_AGENT_ENDGAMESOLVER_HPP
+#define __INCLUDE_GUARD_AGENT_ENDGAMESOLVER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "engine_GameState.hpp"
+#include "engine_Move.hpp"
+#include "engine_MoveList.hpp"
+#include "util_General.hpp"
+#include "util_TimeStamp.hpp"
+
+namespace agent {
+
+/**
+ * Iterative deepening alpha-beta over the end of the game, valued by the
+ * final score difference (score + sun / 3) of player 0 minus player 1. The
+ * tree tie break is ignored.
+ *
+ * Simultaneous turns are searched the way GameState::Turn plays them:
+ * player 0 commits first and player 1 answers, so the value is what player
+ * 0 can guarantee whatever player 1 does.
+ */
+class EndgameSolver {
+ public:
+  using GameState = engine::GameState;
+  using Move = engine::Move;
+  using MoveList = engine::MoveList;
+  using TimeStamp = util::TimeStamp;
+
+  struct Result {
+    /* The search reached the end of the game on every line. */
+    bool solved;
+    int value;
+    Move best;
+    size_t n_nodes;
+  };
+
+  /**
+   * n_entries is rounded down to a power of two.
+   */
+  explicit EndgameSolver(size_t n_entries = 1u << 18) {
+    while (n_entries & (n_entries - 1u)) {
+      n_entries &= n_entries - 1u;
+    }
+    table_.resize(std::max<size_t>(n_entries, 1u));
+  }
+
+  /**
+   * Deepens until the game is solved or time_limit seconds have passed since
+   * start, returning the last completed iteration.
+   */
+  Result Solve(GameState const& g, uint64_t arid, TimeStamp const& start,
+               double time_limit) {
+    std::fill(table_.begin(), table_.end(), Entry{});
+    arid_ = arid;
+    start_ = &start;
+    time_limit_ = time_limit;
+    aborted_ = false;
+    n_nodes_ = 0u;
+
+    Result result{false, StaticValue(g), Move::Wait(), 0u};
+    for (u_int depth = 1; depth < kSolvedDepth; ++depth) {
+      bool exact = true;
+      Move best = Move::Wait();
+      int value = Search(g, depth, -kInfinity, kInfinity, exact, best);
+      if (aborted_) {
+        break;
+      }
+
+      result = Result{exact, value, best, n_nodes_};
+      if (exact) {
+        break;
+      }
+    }
+
+    result.n_nodes = n_nodes_;
+    return result;
+  }
+
+  static int StaticValue(GameState const& g) {
+    return (g.GetScore(0) + g.GetSun(0) / 3) -
+           (g.GetScore(1) + g.GetSun(1) / 3);
+  }
+
+ private:
+  static int constexpr kInfinity = 1 << 14;
+  /* Depth of entries searched to the end of the game. */
+  static u_int constexpr kSolvedDepth = 0xFF;
+  static size_t constexpr kTimeCheckInterval = 1024u;
+
+  enum class Bound : uint8_t { kExact, kLower, kUpper };
+
+  struct Entry {
+    uint64_t key{};
+    int16_t value{};
+    uint8_t depth{};
+    Bound bound{};
+    uint16_t move{};
+  };
+
+  std::vector<Entry> table_;
+  uint64_t arid_{};
+  TimeStamp const* start_{};
+  double time_limit_{};
+  bool aborted_{};
+  size_t n_nodes_{};
+
+  /**
+   * exact is cleared if the depth limit cut any line short.
+   */
+  int Search(GameState const& g, u_int depth, int alpha, int beta,
+             bool& exact, Move& best) {
+    if (++n_nodes_ % kTimeCheckInterval == 0 &&
+        start_->Since() >= time_limit_) {
+      aborted_ = true;
+    }
+    if (aborted_) {
+      return 0;
+    }
+
+    if (g.IsTerminal()) {
+      return StaticValue(g);
+    }
+    if (depth == 0) {
+      exact = false;
+      return StaticValue(g);
+    }
+
+    Entry& entry = table_[g.Hash() & (table_.size() - 1u)];
+    Move hash_move = Move::Invalid();
+    if (entry.key == g.Hash()) {
+      hash_move = Move::FromInt(entry.move);
+      if (entry.depth >= depth) {
+        bool cutoff = entry.bound == Bound::kExact ||
+                      (entry.bound == Bound::kLower && entry.value >= beta) ||
+                      (entry.bound == Bound::kUpper && entry.value <= alpha);
+        if (cutoff) {
+          exact = exact && entry.depth == kSolvedDepth;
+          best = hash_move;
+          return entry.value;
+        }
+      }
+    }
+
+    u_int player = g.NextPlayer();
+    bool is_maximizing = player == 0u;
+    MoveList moves = GetOrderedMoves(g, player, hash_move);
+
+    int original_alpha = alpha;
+    int original_beta = beta;
+    int best_value = is_maximizing ? -kInfinity : kInfinity;
+    bool node_exact = true;
+    for (auto const& m : moves) {
+      GameState next = g;
+      next.Turn(player, m, arid_);
+
+      Move reply;
+      int value = Search(next, depth - 1u, alpha, beta, node_exact, reply);
+      if (aborted_) {
+        return 0;
+      }
+
+      if (is_maximizing ? value > best_value : value < best_value) {
+        best_value = value;
+        best = m;
+      }
+      if (is_maximizing) {
+        alpha = std::max(alpha, value);
+      } else {
+        beta = std::min(beta, value);
+      }
+      if (alpha >= beta) {
+        break;
+      }
+    }
+
+    exact = exact && node_exact;
+
+    entry.key = g.Hash();
+    entry.value = static_cast<int16_t>(best_value);
+    entry.depth = static_cast<uint8_t>(node_exact ? kSolvedDepth : depth);
+    entry.move = Move::ToInt(best);
+    if (best_value <= original_alpha) {
+      entry.bound = Bound::kUpper;
+    } else if (best_value >= original_beta) {
+      entry.bound = Bound::kLower;
+    } else {
+      entry.bound = Bound::kExact;
+    }
+
+    return best_value;
+  }
+
+  /**
+   * Every legal move, hash move first, then completes, grows of the tallest
+   * trees, waits and seeds.
+   *
+   * Moves that can only cost their owner are dropped: seeds from day 22, as
+   * they can no longer grow in time to collect sun, and grows on the last
+   * day, as the tree can't be completed anymore.
+   */
+  MoveList GetOrderedMoves(GameState const& g, u_int player,
+                           Move const& hash_move) const {
+    MoveList moves;
+    auto add = [&](Move const& m) { moves.push_back(m); };
+    if (g.GetDay() == 23) {
+      g.GetMoves<GameState::MoveFilter<false, false, false>>(player, add,
+                                                              arid_);
+    } else if (g.GetDay() == 22) {
+      g.GetMoves<GameState::MoveFilter<false, false>>(player, add, arid_);
+    } else {
+      g.GetMoves<GameState::MoveFilter<false>>(player, add, arid_);
+    }
+
+    auto rank = [&](Move const& m) -> int {
+      if (Move::ToInt(m) == Move::ToInt(hash_move)) {
+        return 0;
+      }
+      switch (m.GetType()) {
+        case Move::Type::kComplete:
+          return 1;
+        case Move::Type::kGrow:
+          return (g.GetTrees(2) & engine::GetTree(m.GetTarget())) ? 2
+                 : (g.GetTrees(1) & engine::GetTree(m.GetTarget())) ? 3
+                                                                   : 4;
+        case Move::Type::kWait:
+          return 6;
+        default:
+          return 7;
+      }
+    };
+    std::stable_sort(moves.begin(), moves.end(),
+                     [&](Move const& l, Move const& r) {
+                       return rank(l) < rank(r);
+                     });
+
+    return moves;
+  }
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_ENDGAMESOLVER_HPP */
@@ -1,15 +1,28 @@
 #ifndef __INCLUDE_GUARD_AGENT_MCTS_HPP
 #define __INCLUDE_GUARD_AGENT_MCTS_HPP
 
+#include <pthread.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cfloat>
 #include <cstdint>
-#include <optional>
+#include <functional>
+#include <random>
+#include <string>
 #include <vector>
 
 #include "engine_Agent.hpp"
 #include "engine_GameState.hpp"
 #include "engine_Move.hpp"
+#include "engine_MoveList.hpp"
+#include "agent_ChildStats.hpp"
+#include "agent_EndgameSolver.hpp"
+#include "agent_NodeArena.hpp"
+#include "agent_SearchProfile.hpp"
+#include "agent_TimeManager.hpp"
+#include "agent_TranspositionTable.hpp"
 #include "util_General.hpp"
 #include "util_TimeStamp.hpp"
 
@@ -18,186 +31,777 @@ class Mcts : public engine::Agent {
  public:
   using GameState = engine::GameState;
   using Move = engine::Move;
+  using MoveList = engine::MoveList;
+  using MoveSet = engine::MoveSet;
   using TimeStamp = util::TimeStamp;
 
+  /**
+   * Tree node in a NodeArena. Unexplored moves are not stored: the k-th
+   * expansion takes GetTreeMoves(gs)[(move_offset + k * kExpandStride) %
+   * n_moves], visiting every move once in an order set by the random offset.
+   *
+   * The statistics of the k-th expanded child are slot block + k of
+   * ChildStats. A recycled node keeps its block if the capacity matches and
+   * frees it to ChildStats otherwise. A slot with visits but no child was
+   * collapsed by Collapse.
+   */
   struct Node {
     GameState gs;
-    std::vector<Node> children;
-    std::vector<Move> unexplored;
+    uint32_t first_child{kNull};
+    uint32_t next_sibling{kNull};
+    uint32_t block{kNull};
     uint32_t n_rollouts{};
-    float score{};
+    TranspositionTable::Entry* shared{};
     Move preceeding;
+    uint16_t block_capacity{};
+    uint16_t n_moves{};
+    uint16_t n_expanded{};
+    uint16_t move_offset{};
 
-    Node(GameState const& a_gs, std::vector<Move>&& a_unexplored,
-         Move const& a_preceeding = Move::Invalid())
-        : gs(a_gs),
-          unexplored(std::move(a_unexplored)),
-          preceeding(a_preceeding) {}
+    bool IsExpanded() const {
+      return util::AtomicLoad(n_expanded) >= n_moves;
+    }
   };
 
+  /**
+   * transposition_entries > 0 shares rollout statistics between tree nodes
+   * that hold the same position, bounded to that many entries.
+   *
+   * n_threads > 1 searches one shared tree from that many threads, Heuristic
+   * must then be safe to call concurrently.
+   */
+  explicit Mcts(size_t transposition_entries = 0u, u_int n_threads = 1u)
+      : table_(transposition_entries), n_threads_(n_threads) {
+    nodes_.SetBudget(kNodeBudget);
+  }
+  ~Mcts() { StopPondering(); }
+
   virtual float Heuristic(GameState const& gamestate) {
     return Simulate(gamestate);
   }
 
+  /**
+   * Heuristic of every leaf into scores, for a search with SetLeafBatch.
+   * Overridden by heuristics that are cheaper per leaf on many at once.
+   */
+  virtual void HeuristicBatch(std::vector<GameState const*> const& leaves,
+                              float* scores) {
+    for (size_t i = 0; i < leaves.size(); ++i) {
+      scores[i] = Heuristic(*leaves[i]);
+    }
+  }
+
   void Init() override {
     Agent::Init();
-    ResetHistory();
-    first_turn_ = true;
+    ResetSearch();
   }
 
-  virtual bool CheckLimit(TimeStamp const& start, size_t n_rollouts,
-                          bool first_turn) {
-    return start.Since() >= (first_turn ? 0.995 : 0.095);
+  /**
+   * Init for a search driven by another agent, which read the board.
+   */
+  void Init(uint64_t arid) {
+    SetArid(arid);
+    ResetSearch();
   }
 
-  void ResetHistory() { root_.reset(); }
+  /**
+   * Keeps searching the tree while waiting for the opponent's move, see
+   * StartPondering.
+   */
+  void SetPondering(bool ponder) { ponder_ = ponder; }
+
+  /**
+   * Nodes the tree may hold before its least visited subtrees are collapsed,
+   * 0 lets it grow until the search stops.
+   */
+  void SetNodeBudget(size_t budget) {
+    node_budget_ = budget;
+    nodes_.SetBudget(budget);
+  }
+
+  /**
+   * Leaves each search thread selects before evaluating them together with
+   * HeuristicBatch. The virtual losses of the pending ones steer the next
+   * selections elsewhere. 1 evaluates each leaf as soon as it is reached.
+   */
+  void SetLeafBatch(u_int n_leaves) { leaf_batch_ = std::max(n_leaves, 1u); }
+
+  /**
+   * Adds every searched turn to a Chrome trace at path, with
+   * util::ENABLE_PROFILING.
+   */
+  void SetTraceFile(std::string const& path) { profile_.SetTraceFile(path); }
+
+  virtual bool CheckLimit(TimeStamp const& start, size_t n_rollouts) {
+    auto n = static_cast<uint32_t>(n_rollouts);
+    return time_.IsOver(start, n,
+                        TimeManager::IsCheckpoint(n) ? GetRootLead() : 0u);
+  }
+
+  void ResetHistory() {
+    root_ = kNull;
+    nodes_.Clear();
+    stats_.Clear();
+  }
 
   Move ChooseMove(GameState const& state, TimeStamp const& start) override {
-    if (!TrackActualAction(state)) {
-      root_.emplace(state, GetTreeMoves(state));
+    Move solved;
+    if (SolveEndgame(state, start, solved)) {
+      return solved;
     }
 
-    auto& root = root_.value();
-
-    std::vector<Node*> expand_path;
-    while (root.n_rollouts <= 0xFFFFFE) {
-      expand_path.clear();
-      expand_path.push_back(&root);
-      Select(expand_path, true);
+    SearchRoot(state, start);
 
-      if (!expand_path.back()->unexplored.empty()) {
-        Expand(expand_path);
+    Move best = Move::Invalid();
+    float best_value = -FLT_MAX;
+    ForEachRootChild([&](Move const& m, uint32_t n_rollouts, float score) {
+      ASSERT(n_rollouts > 0);
+      if (score / n_rollouts > best_value) {
+        best = m;
+        best_value = score / n_rollouts;
       }
+    });
 
-      float score = Heuristic(expand_path.back()->gs);
+    AdvanceRoot(best);
+    return best;
+  }
 
-      Backup(expand_path, score);
+  /**
+   * Feeds the time the last searched turn took, output included, to its
+   * TimeManager.
+   */
+  void EndTurn(double seconds) override {
+    if (searched_) {
+      time_.EndTurn(seconds);
+      searched_ = false;
+    }
+  }
 
-      if (CheckLimit(start, root.n_rollouts, first_turn_)) {
-        break;
-      }
+  /**
+   * From kSolverDay, solves the game if that fits in kSolverSeconds and
+   * drops the tree, which no longer follows the game.
+   */
+  bool SolveEndgame(GameState const& state, TimeStamp const& start,
+                    Move& best) {
+    if (state.GetDay() < kSolverDay) {
+      return false;
     }
-    if (first_turn_) {
-      // std::cerr << "R: " << root.n_rollouts << std::endl;
+
+    auto result = solver_.Solve(state, GetArid(), start, kSolverSeconds);
+    if (!result.solved) {
+      return false;
     }
 
+    ResetHistory();
     first_turn_ = false;
+    best = result.best;
+    return true;
+  }
+
+  /**
+   * Searches state until CheckLimit, reusing the tree of the last turn if
+   * the game followed it.
+   */
+  void SearchRoot(GameState const& state, TimeStamp const& start) {
+    profile_.StartTurn();
+    bool had_tree = root_ != kNull;
+    bool reused = TrackActualAction(state);
+    if (had_tree) {
+      profile_.RecordReuse(reused);
+    }
+    if (!reused) {
+      ResetHistory();
+      root_ = NewNode(state, Move::Invalid());
+    }
+
+    auto const& root = nodes_[root_];
+    time_.StartTurn(state.GetDay(), root.n_moves, first_turn_,
+                    root.n_rollouts);
+
+    root_maximizing_ = true;
+    stop_ = false;
+    RunSearch(start);
+    searched_ = true;
+    profile_.EndTurn(state.GetDay(), nodes_.size(),
+                     nodes_.size() * sizeof(Node) +
+                         stats_.size() * ChildStats::kSlotBytes);
+
+    first_turn_ = false;
+
+    ASSERT(nodes_[root_].first_child != kNull);
+  }
 
-    ASSERT(!root.children.empty());
+  /**
+   * Calls callable(move, n_rollouts, score) for every child of the root, in
+   * expansion order.
+   */
+  template <class Callable>
+  void ForEachRootChild(Callable&& callable) const {
+    auto const& root = nodes_[root_];
+    for (uint32_t s = root.block; s < root.block + root.n_moves; ++s) {
+      if (stats_.Child(s) != kNull) {
+        callable(nodes_[stats_.Child(s)].preceeding, stats_.Visits(s),
+                 stats_.Score(s));
+      }
+    }
+  }
 
-    auto best = util::MaxElement(root.children.begin(), root.children.end(),
-                                 [](Node const& n) {
-                                   // std::cerr << (n.score / n.n_rollouts) << "
-                                   // " << n.n_rollouts << " "
-                                   //           << n.preceeding << std::endl;
-                                   ASSERT(n.n_rollouts > 0);
-                                   return n.score / n.n_rollouts;
-                                 });
+  /**
+   * Moves the root to the child reached by m, dropping the tree if m was
+   * never expanded.
+   */
+  void AdvanceRoot(Move const& m) {
+    uint32_t c = nodes_[root_].first_child;
+    while (c != kNull &&
+           Move::ToInt(nodes_[c].preceeding) != Move::ToInt(m)) {
+      c = nodes_[c].next_sibling;
+    }
 
-    Node local = std::move(*best);
-    root_ = std::move(local);
-    // std::cerr << "*" << root_.value().preceeding << "\n" << std::endl;
-    return root_.value().preceeding;
+    if (c == kNull) {
+      ResetHistory();
+      return;
+    }
+
+    nodes_.Reroot(root_, c);
+    root_ = c;
+  }
+
+ protected:
+  void SetTimeManager(TimeManager const& time) { time_ = time; }
+
+  /**
+   * Searches on from the root left by the last turn, which holds the
+   * opponent's replies, until StopPondering. SearchRoot then moves the root
+   * to the position read and spends its time there.
+   */
+  void StartPondering() override {
+    if (!ponder_ || root_ == kNull) {
+      return;
+    }
+
+    root_maximizing_ = nodes_[root_].gs.NextPlayer() == 0u;
+    stop_ = false;
+    pondering_ = true;
+    ponder_seed_ = static_cast<unsigned>(Rand());
+    pthread_create(&ponder_thread_, nullptr, RunPonder, this);
+  }
+
+  void StopPondering() override {
+    if (!pondering_) {
+      return;
+    }
+
+    stop_ = true;
+    pthread_join(ponder_thread_, nullptr);
+    pondering_ = false;
   }
 
  private:
-  std::optional<Node> root_;
+  struct Stats {
+    uint32_t n_rollouts;
+    float score;
+  };
+
+  /* A node on a search path and the ChildStats slot it was reached by, and
+   * the transposition entry holding its virtual loss, if any. */
+  struct Step {
+    uint32_t node;
+    uint32_t slot;
+    TranspositionTable::Entry* shared{};
+  };
+
+  /**
+   * From kSolverDay the last days are usually small enough to solve exactly,
+   * the solver gets up to kSolverSeconds of the turn before search takes over.
+   */
+  static uint8_t constexpr kSolverDay = 22u;
+  static double constexpr kSolverSeconds = 0.045;
+
+  static uint32_t constexpr kNull = NodeArena<Node>::kNull;
+  /* Prime above any move count, so it is coprime with all of them. */
+  static uint32_t constexpr kExpandStride = 7919u;
+  static_assert(MoveList::kCapacity < kExpandStride);
+
+  /* Added to a node's score while a rollout through it is pending, as a loss
+   * for the player who chose it, so other threads prefer other lines. */
+  static float constexpr kVirtualLoss = 1.0f;
+
+  /* Default for SetNodeBudget, a node and its child slots take about 500
+   * bytes. */
+  static size_t constexpr kNodeBudget = 1u << 19;
+
+  NodeArena<Node> nodes_;
+  ChildStats stats_;
+  uint32_t root_{kNull};
+  TranspositionTable table_;
+  EndgameSolver solver_;
+  TimeManager time_;
+  /* Whether the current turn was searched, rather than solved. */
+  bool searched_{};
+  SearchProfile profile_;
   bool first_turn_{true};
+  u_int n_threads_;
+  u_int leaf_batch_{1u};
+  std::atomic<bool> stop_{};
+  /* Set when the tree reached node_budget_, to stop and Collapse. */
+  std::atomic<bool> collect_{};
+  size_t node_budget_{kNodeBudget};
+  /* Whether player 0 moves at the root, the players alternate below. */
+  bool root_maximizing_{true};
+  bool ponder_{};
+  bool pondering_{};
+  unsigned ponder_seed_{};
+  pthread_t ponder_thread_{};
+
+  void ResetSearch() {
+    ResetHistory();
+    table_.Clear();
+    first_turn_ = true;
+  }
+
+  /* Random engine of the search thread running on this thread, if any. */
+  static inline thread_local std::default_random_engine* worker_rand_{};
+
+  struct Worker {
+    Mcts* mcts;
+    TimeStamp const* start;
+    unsigned seed;
+    pthread_t thread{};
+  };
+
+  static void* RunPonder(void* ptr) {
+    Mcts& mcts = *static_cast<Mcts*>(ptr);
+    std::default_random_engine rand_engine(mcts.ponder_seed_);
+    worker_rand_ = &rand_engine;
+    TimeStamp start;
+    mcts.RunSearch(start);
+    worker_rand_ = nullptr;
+    return nullptr;
+  }
+
+  static void* RunWorker(void* ptr) {
+    Worker& worker = *static_cast<Worker*>(ptr);
+    std::default_random_engine rand_engine(worker.seed);
+    worker_rand_ = &rand_engine;
+    worker.mcts->Search(*worker.start);
+    worker_rand_ = nullptr;
+    return nullptr;
+  }
+
+  /**
+   * Searches until stop_, collapsing the tree whenever it is full.
+   */
+  void RunSearch(TimeStamp const& start) {
+    do {
+      collect_ = false;
+      if (n_threads_ > 1) {
+        SearchParallel(start);
+      } else {
+        Search(start);
+      }
+      if (collect_) {
+        Collapse();
+      }
+    } while (collect_ && !stop_);
+  }
+
+  /**
+   * Search loop shared by every thread until one of them hits the limit or
+   * the node budget. Each round selects up to leaf_batch_ leaves, evaluates
+   * them together and backs them up.
+   */
+  void Search(TimeStamp const& start) {
+    auto& root = nodes_[root_];
+
+    std::vector<std::vector<Step>> paths(leaf_batch_);
+    std::vector<GameState const*> leaves;
+    std::vector<float> scores(leaf_batch_);
+    SearchProfile::Rollouts rollouts;
+    while (util::AtomicLoad(root.n_rollouts) <= 0xFFFFFE && !stop_ &&
+           !collect_) {
+      leaves.clear();
+      /* A full tree still gets a rollout per round, as Collapse may leave
+       * it full. */
+      while (leaves.empty() ||
+             (leaves.size() < leaf_batch_ && !nodes_.IsFull())) {
+        auto& expand_path = paths[leaves.size()];
+        expand_path.clear();
+        expand_path.push_back(Step{root_, kNull});
+        profile_.Time(SearchProfile::kSelect,
+                      [&] { Select(expand_path, root_maximizing_); });
+
+        if (!nodes_[expand_path.back().node].IsExpanded()) {
+          profile_.Time(SearchProfile::kExpand, [&] { Expand(expand_path); });
+        }
+        if (table_.IsEnabled()) {
+          AddSharedVirtualLoss(expand_path);
+        }
+        leaves.push_back(&nodes_[expand_path.back().node].gs);
+      }
+
+      profile_.Time(SearchProfile::kHeuristic,
+                    [&] { HeuristicBatch(leaves, scores.data()); });
+
+      for (size_t i = 0; i < leaves.size(); ++i) {
+        profile_.Time(SearchProfile::kBackup,
+                      [&] { Backup(paths[i], scores[i]); });
+        rollouts.Add(paths[i].size() - 1u);
+
+        uint32_t n_rollouts = util::AtomicLoad(root.n_rollouts);
+        if (!pondering_ && CheckLimit(start, n_rollouts)) {
+          stop_ = true;
+        }
+      }
+      if (nodes_.IsFull()) {
+        collect_ = true;
+      }
+    }
+    profile_.AddRollouts(rollouts);
+  }
+
+  /**
+   * Search on n_threads_ threads, the calling one included.
+   */
+  void SearchParallel(TimeStamp const& start) {
+    std::vector<Worker> workers(n_threads_ - 1u);
+    for (auto& worker : workers) {
+      worker.mcts = this;
+      worker.start = &start;
+      worker.seed = static_cast<unsigned>(Rand());
+      pthread_create(&worker.thread, nullptr, RunWorker, &worker);
+    }
+
+    Search(start);
+
+    for (auto& worker : workers) {
+      pthread_join(worker.thread, nullptr);
+    }
+  }
+
+  /**
+   * Virtual loss of the node at depth in a path, negative when player 0
+   * chose it.
+   */
+  float VirtualLoss(size_t depth) const {
+    return (depth % 2 == 1) == root_maximizing_ ? -kVirtualLoss
+                                                : kVirtualLoss;
+  }
+
+  /**
+   * Statistics of node n reached by slot, preferring the shared entry unless
+   * it was replaced since this node last wrote to it.
+   */
+  Stats GetStats(Node const& n, uint32_t slot) const {
+    Stats stats{util::AtomicLoad(n.n_rollouts), 0.0f};
+    if (slot != kNull) {
+      stats.score = util::AtomicLoad(stats_.Score(slot));
+    }
+    auto const* shared = util::AtomicLoad(n.shared);
+    if (shared && util::AtomicLoad(shared->key) == n.gs.Hash()) {
+      Stats shared_stats{util::AtomicLoad(shared->n_rollouts),
+                         util::AtomicLoad(shared->score)};
+      /* Insert may have given the entry to another position meanwhile. */
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (shared_stats.n_rollouts >= stats.n_rollouts &&
+          util::AtomicLoad(shared->key) == n.gs.Hash()) {
+        return shared_stats;
+      }
+    }
+    return stats;
+  }
+
+  /**
+   * Visits by which the most visited root child leads the runner up, 0 while
+   * the root has unexpanded moves or another child has a better mean.
+   */
+  uint32_t GetRootLead() const {
+    auto const& root = nodes_[root_];
+    if (!root.IsExpanded()) {
+      return 0u;
+    }
+
+    uint32_t most = 0u;
+    uint32_t runner_up = 0u;
+    bool most_is_best = false;
+    float best_value = -FLT_MAX;
+    for (uint32_t s = root.block; s < root.block + root.n_moves; ++s) {
+      uint32_t visits = util::AtomicLoad(stats_.Visits(s));
+      if (visits == 0u) {
+        continue;
+      }
+
+      float value = util::AtomicLoad(stats_.Score(s)) / visits;
+      bool is_best = value > best_value;
+      if (is_best) {
+        best_value = value;
+      }
+      if (visits > most) {
+        runner_up = most;
+        most = visits;
+        most_is_best = is_best;
+      } else {
+        runner_up = std::max(runner_up, visits);
+        most_is_best = most_is_best && !is_best;
+      }
+    }
+    return most_is_best ? most - runner_up : 0u;
+  }
 
   bool TrackActualAction(GameState const& gs) {
-    if (!root_) {
+    if (root_ == kNull) {
       return false;
     }
 
-    auto& root = root_.value();
+    auto& root = nodes_[root_];
 
     if (root.gs.NextPlayer() == 0u) {
-      if (!(root.gs == gs)) {
-        std::cerr << static_cast<uint16_t>(root.gs.GetDay()) << " "
-                  << static_cast<uint16_t>(gs.GetDay()) << std::endl;
-        std::cerr << static_cast<uint16_t>(root.gs.GetScore(0)) << " "
-                  << static_cast<uint16_t>(gs.GetScore(0)) << std::endl;
-        std::cerr << static_cast<uint16_t>(root.gs.GetScore(11)) << " "
-                  << static_cast<uint16_t>(gs.GetScore(1)) << std::endl;
-        std::cerr << static_cast<uint16_t>(root.gs.GetSun(0)) << " "
-                  << static_cast<uint16_t>(gs.GetSun(0)) << std::endl;
-        std::cerr << static_cast<uint16_t>(root.gs.GetSun(1)) << " "
-                  << static_cast<uint16_t>(gs.GetSun(1)) << std::endl;
-      }
       ASSERT(root.gs == gs);
       /* Opponent is waiting so we predicted the state internally. */
-      // std::cerr << "Op is waiting, reused " << root.n_rollouts << " trials"
-      //           << std::endl;
       return true;
     }
 
-    auto new_root =
-        std::find_if(root.children.begin(), root.children.end(),
-                     [&](Node const& child) { return child.gs == gs; });
-    if (new_root == root.children.end()) {
+    uint32_t new_root = nodes_.GetFirstChild(root_);
+    while (new_root != kNull && nodes_[new_root].gs.Hash() != gs.Hash()) {
+      new_root = nodes_[new_root].next_sibling;
+    }
+    if (new_root == kNull) {
       /* Opponent took a move we never explored, or multiple moves while we
        * waited. */
       return false;
     }
 
+    ASSERT(nodes_[new_root].gs == gs);
+
     /* Found the opponent's move, preserve the node. */
-    // std::cerr << "Op did: " << new_root->preceeding << " reused "
-    //           << new_root->n_rollouts << " trials" << std::endl;
-    Node local = std::move(*new_root);
-    root_ = std::move(local);
+    nodes_.Reroot(root_, new_root);
+    root_ = new_root;
     return true;
   }
 
-  void Select(std::vector<Node*>& path, bool is_maximizing) {
-    Node& back = *path.back();
-    if (!back.unexplored.empty()) {
+  uint32_t NewNode(GameState const& gs, Move const& preceeding) {
+    auto n_moves = static_cast<uint16_t>(GetTreeMoves(gs).size());
+
+    uint32_t index = nodes_.Allocate();
+    Node& node = nodes_[index];
+    uint32_t block = node.block;
+    uint16_t capacity = node.block_capacity;
+    /* Blocks are kept to their exact capacity, a larger one held on to would
+     * leave the smaller freed ones unused and the pool growing. */
+    if (block == kNull || capacity != ChildStats::Capacity(n_moves)) {
+      if (block != kNull) {
+        stats_.Free(block, capacity);
+      }
+      block = stats_.Allocate(n_moves);
+      capacity = static_cast<uint16_t>(ChildStats::Capacity(n_moves));
+    }
+    stats_.ClearBlock(block, capacity);
+
+    node = Node();
+    node.gs = gs;
+    node.block = block;
+    node.preceeding = preceeding;
+    node.block_capacity = capacity;
+    node.n_moves = n_moves;
+    node.move_offset =
+        static_cast<uint16_t>(n_moves > 0 ? Rand() % n_moves : 0);
+    return index;
+  }
+
+  /**
+   * Counts a pending rollout through the node at depth.
+   */
+  void AddVirtualLoss(Step const& step, size_t depth) {
+    util::AtomicAdd(nodes_[step.node].n_rollouts, 1u);
+    AddSlotVirtualLoss(step, depth);
+  }
+
+  void AddSlotVirtualLoss(Step const& step, size_t depth) {
+    util::AtomicAdd(stats_.Visits(step.slot), 1u);
+    util::AtomicAdd(stats_.Score(step.slot), VirtualLoss(depth));
+  }
+
+  void Select(std::vector<Step>& path, bool is_maximizing) {
+    Node& back = nodes_[path.back().node];
+    if (!back.IsExpanded()) {
       /* Unexplored actions on this path, we should explore them before going
        * deeper. */
       return;
     }
 
-    if (back.children.empty()) {
-      /* Terminal node (everything explored, no children), can't grow. */
-      ASSERT(back.gs.IsTerminal());
+    /* The root only counts backed up rollouts, pending ones may have
+     * expanded it. */
+    ASSERT(util::AtomicLoad(back.n_rollouts) > 0 || path.size() == 1u);
+
+    float factor = is_maximizing ? 1.0 : -1.0;
+    float exploration =
+        ChildStats::Exploration(GetStats(back, path.back().slot).n_rollouts);
+
+    uint32_t slot = table_.IsEnabled()
+                        ? SelectShared(back, factor, exploration)
+                        : stats_.SelectUct(back.block, back.n_moves, factor,
+                                           exploration);
+    uint32_t child =
+        slot == kNull ? kNull
+                      : __atomic_load_n(&stats_.Child(slot), __ATOMIC_ACQUIRE);
+    if (child == kNull && slot != kNull) {
+      child = Restore(path.back().node, slot);
+    }
+    if (child == kNull) {
+      /* Terminal node (everything explored, no children), can't grow. Other
+       * threads may also still be expanding the last moves. */
+      ASSERT(back.gs.IsTerminal() || n_threads_ > 1);
       return;
     }
 
-    ASSERT(back.n_rollouts > 0);
+    /* Grow path and keep trying to find something to expand. */
+    Step step{child, slot};
+    AddVirtualLoss(step, path.size());
+    path.push_back(step);
+    Select(path, !is_maximizing);
+  }
 
-    float factor = is_maximizing ? 1.0 : -1.0;
+  /**
+   * Scalar SelectUct on the statistics shared through the transposition
+   * table.
+   */
+  uint32_t SelectShared(Node const& back, float factor, float exploration) {
+    uint32_t max = kNull;
+    float max_value = -FLT_MAX;
+    for (uint32_t s = back.block; s < back.block + back.n_moves; ++s) {
+      uint32_t child = __atomic_load_n(&stats_.Child(s), __ATOMIC_ACQUIRE);
+      /* A collapsed child only has its slot, Select restores it if picked. */
+      Stats stats{util::AtomicLoad(stats_.Visits(s)),
+                  util::AtomicLoad(stats_.Score(s))};
+      if (child != kNull) {
+        stats = GetStats(nodes_[child], s);
+      }
+      if (stats.n_rollouts == 0u) {
+        continue;
+      }
 
-    auto max = util::MaxElement(
-        back.children.begin(), back.children.end(), [&](Node const& child) {
-          ASSERT(child.n_rollouts > 0);
+      float value = factor * stats.score / stats.n_rollouts +
+                    exploration / std::sqrt(stats.n_rollouts);
+      if (value > max_value) {
+        max = s;
+        max_value = value;
+      }
+    }
+    return max;
+  }
 
-          float value =
-              factor * child.score / child.n_rollouts +
-              std::sqrt(2.0f * std::log(back.n_rollouts) / child.n_rollouts);
-          return value;
-        });
+  void Expand(std::vector<Step>& path) {
+    uint32_t parent = path.back().node;
+    auto& node = nodes_[parent];
+    uint32_t k = util::AtomicAdd(node.n_expanded, uint16_t{1});
+    if (k >= node.n_moves) {
+      /* Another thread took the last move. */
+      return;
+    }
 
-    /* Grow path and keep trying to find something to expand. */
-    path.push_back(&*max);
-    Select(path, !is_maximizing);
+    /* The child counts its pending rollout before it is published, so
+     * SelectShared never finds it unvisited. The slot gets its visit after,
+     * a visited slot without a child being a collapsed one to Select. */
+    Step step{NewChild(node, k), node.block + k};
+    nodes_[step.node].n_rollouts = 1u;
+    nodes_.AddChild(parent, step.node);
+    __atomic_store_n(&stats_.Child(step.slot), step.node, __ATOMIC_RELEASE);
+    AddSlotVirtualLoss(step, path.size());
+    path.push_back(step);
   }
 
-  void Expand(std::vector<Node*>& path) {
-    auto& unexplored = path.back()->unexplored;
-    auto it = unexplored.begin() + Rand() % unexplored.size();
-    auto move = *it;
-    unexplored.erase(it);
+  /**
+   * New node for the k-th expansion of node.
+   */
+  uint32_t NewChild(Node const& node, uint32_t k) {
+    auto moves = GetTreeMoves(node.gs);
+    ASSERT(moves.size() == node.n_moves);
+    auto move = moves[(node.move_offset + k * kExpandStride) % node.n_moves];
 
-    GameState next(path.back()->gs);
+    GameState next(node.gs);
     next.Turn(next.NextPlayer(), move, GetArid());
-    path.back()->children.emplace_back(next, GetTreeMoves(next), move);
-    path.emplace_back(&path.back()->children.back());
+    return NewNode(next, move);
+  }
+
+  /**
+   * Grows the collapsed child in slot of parent again, its statistics are
+   * still in the slot. Returns the child, which another thread may have
+   * restored first.
+   */
+  uint32_t Restore(uint32_t parent, uint32_t slot) {
+    auto& node = nodes_[parent];
+    uint32_t child = NewChild(node, slot - node.block);
+    /* SelectShared counts the child's rollouts, not the slot's. */
+    nodes_[child].n_rollouts = util::AtomicLoad(stats_.Visits(slot));
+    uint32_t expected = kNull;
+    if (!__atomic_compare_exchange_n(&stats_.Child(slot), &expected, child,
+                                     false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE)) {
+      nodes_.Release(child);
+      return expected;
+    }
+    nodes_.AddChild(parent, child);
+    return child;
   }
 
-  std::vector<Move> GetRawMoves(GameState const& g) const {
-    return g.GetMoves(g.NextPlayer(), GetArid());
+  /**
+   * Releases the least visited subtrees until about half the node budget is
+   * used. Their statistics stay in the parent's slots for Select, which
+   * restores them when picked. The root's children are always kept.
+   */
+  void Collapse() {
+    std::vector<uint32_t> order{root_};
+    std::vector<uint32_t> visits;
+    for (size_t i = 0; i < order.size(); ++i) {
+      for (uint32_t c = nodes_[order[i]].first_child; c != kNull;
+           c = nodes_[c].next_sibling) {
+        order.push_back(c);
+        visits.push_back(nodes_[c].n_rollouts);
+      }
+    }
+
+    size_t keep = node_budget_ / 2u;
+    if (visits.size() <= keep) {
+      return;
+    }
+    std::nth_element(visits.begin(), visits.begin() + keep, visits.end(),
+                     std::greater<uint32_t>());
+    uint32_t cutoff = visits[keep];
+
+    /* A child never has more visits than its parent, parents come first. */
+    for (size_t i = 1; i < order.size(); ++i) {
+      Node& node = nodes_[order[i]];
+      if (node.n_rollouts <= cutoff) {
+        continue;
+      }
+
+      uint32_t* link = &node.first_child;
+      while (*link != kNull) {
+        uint32_t c = *link;
+        if (nodes_[c].n_rollouts > cutoff) {
+          link = &nodes_[c].next_sibling;
+          continue;
+        }
+
+        *link = nodes_[c].next_sibling;
+        uint32_t s = node.block;
+        uint32_t end = node.block + node.n_moves;
+        while (s < end && stats_.Child(s) != c) {
+          ++s;
+        }
+        ASSERT(s < end);
+        if (s < end) {
+          stats_.Child(s) = kNull;
+        }
+        nodes_.Release(c);
+      }
+    }
+  }
+
+  MoveList GetRawMoves(GameState const& g) const {
+    return g.GetMoves<GameState::MoveFilter<>>(g.NextPlayer(), GetArid());
   }
 
-  std::vector<Move> GetTreeMoves(GameState const& g) const {
+  MoveList GetTreeMoves(GameState const& g) const {
     auto params = GameState::MoveFilterParams::Default();
     params.can_seed = g.GetNumTrees(g.NextPlayer(), 0) == 0;
 
@@ -207,7 +811,7 @@ class Mcts : public engine::Agent {
       params.can_complete = false;
     }
 
-    std::vector<Move> moves;
+    MoveList moves;
 
     bool can_seed = false;
     auto filter = [&](Move const& m) {
@@ -220,7 +824,9 @@ class Mcts : public engine::Agent {
       moves.emplace_back(m);
     };
 
-    g.GetMoves(g.NextPlayer(), filter, GetArid(), params);
+    GameState::DispatchMoveFilter(params, [&](auto move_filter) {
+      g.GetMoves<decltype(move_filter)>(g.NextPlayer(), filter, GetArid());
+    });
 
     if ((!can_seed || day > 21) && !g.IsTerminal()) {
       moves.emplace_back(Move::Wait());
@@ -229,7 +835,7 @@ class Mcts : public engine::Agent {
     return moves;
   }
 
-  std::vector<Move> GetRolloutMoves(GameState const& g) const {
+  MoveSet GetRolloutMoves(GameState const& g) const {
     auto params = GameState::MoveFilterParams::Default();
     params.can_seed = g.GetNumTrees(g.NextPlayer(), 0) == 0;
 
@@ -245,71 +851,98 @@ class Mcts : public engine::Agent {
       params.can_grow = false;
     }
 
-    std::vector<Move> moves;
+    /* Don't grow if we can complete, don't seed if we can grow or complete. */
+    return GameState::DispatchMoveFilter(params, [&](auto filter) {
+      auto moves = g.GetMoveSet<decltype(filter)>(g.NextPlayer(), GetArid());
+      moves.KeepPreferred();
+      return moves;
+    });
+  }
 
-    bool can_complete = false;
-    bool can_grow = false;
-    bool can_seed = false;
-    auto filter = [&](Move const& m) {
-      switch (m.GetType()) {
-        case Move::Type::kWait:
-          return;
-        case Move::Type::kComplete:
-          can_complete = true;
-          break;
-        case Move::Type::kGrow:
-          can_grow = true;
-          break;
-        case Move::Type::kSeed:
-          can_seed = true;
-          break;
-      }
-      moves.emplace_back(m);
-    };
+  float Simulate(GameState const& state) {
+    GameState g = state;
+    while (!g.IsTerminal()) {
+      auto moves = GetRolloutMoves(g);
+      g.Turn(g.NextPlayer(), moves.Sample([&]() { return Rand(); }),
+             GetArid());
+    }
 
-    g.GetMoves(g.NextPlayer(), filter, GetArid(), params);
+    return Score(g);
+  }
 
-    if (can_grow && can_complete) {
-      /* Don't grow if we can complete. */
-      moves.erase(std::remove_if(moves.begin(), moves.end(),
-                                 [](Move const& m) {
-                                   return m.GetType() == Move::Type::kGrow;
-                                 }),
-                  moves.end());
-      can_grow = false;
-    }
+  static float Score(GameState const& game) {
+    return Score(game.GetScore(0) + game.GetSun(0) / 3,
+                 game.GetScore(1) + game.GetSun(1) / 3);
+  }
 
-    if (can_seed && (can_grow || can_complete)) {
-      /* Don't seed if we can grow or complete. */
-      moves.erase(std::remove_if(moves.begin(), moves.end(),
-                                 [](Move const& m) {
-                                   return m.GetType() == Move::Type::kSeed;
-                                 }),
-                  moves.end());
-      can_seed = false;
+  /**
+   * Transposition entry of node, claiming one if its own was given to
+   * another position.
+   */
+  TranspositionTable::Entry* GetShared(Node& node) {
+    auto* shared = util::AtomicLoad(node.shared);
+    if (!shared || util::AtomicLoad(shared->key) != node.gs.Hash()) {
+      shared = &table_.Insert(node.gs.Hash());
+      __atomic_store_n(&node.shared, shared, __ATOMIC_RELAXED);
     }
+    return shared;
+  }
 
-    if (!g.IsTerminal()) {
-      moves.emplace_back(Move::Wait());
+  /**
+   * Adds the virtual losses of path below the root to the transposition
+   * entries GetStats prefers, so other threads see the pending rollout too.
+   */
+  void AddSharedVirtualLoss(std::vector<Step>& path) {
+    for (size_t depth = 1; depth < path.size(); ++depth) {
+      auto* shared = GetShared(nodes_[path[depth].node]);
+      util::AtomicAdd(shared->n_rollouts, 1u);
+      util::AtomicAdd(shared->score, VirtualLoss(depth));
+      path[depth].shared = shared;
     }
-
-    return moves;
   }
 
-  float Simulate(GameState const& state) {
-    GameState g = state;
-    while (!g.IsTerminal()) {
-      auto moves = GetRolloutMoves(g);
-      g.Turn(g.NextPlayer(), moves[Rand() % moves.size()], GetArid());
+  /**
+   * Adds score along path, replacing the virtual losses of every node below
+   * the root.
+   */
+  void Backup(std::vector<Step> const& path, float score) {
+    util::AtomicAdd(nodes_[path[0].node].n_rollouts, 1u);
+    for (size_t depth = 1; depth < path.size(); ++depth) {
+      util::AtomicAdd(stats_.Score(path[depth].slot),
+                      score - VirtualLoss(depth));
     }
 
-    return Score(g);
+    if (table_.IsEnabled()) {
+      for (size_t depth = 0; depth < path.size(); ++depth) {
+        Node& node = nodes_[path[depth].node];
+        auto* shared = path[depth].shared;
+        if (shared && util::AtomicLoad(shared->key) == node.gs.Hash() &&
+            util::AtomicLoad(shared->n_rollouts) > 0u) {
+          /* The virtual loss already counted the rollout. */
+          util::AtomicAdd(shared->score, score - VirtualLoss(depth));
+          continue;
+        }
+
+        /* The root, or a node whose entry was given away meanwhile. */
+        shared = GetShared(node);
+        util::AtomicAdd(shared->n_rollouts, 1u);
+        util::AtomicAdd(shared->score, score);
+      }
+    }
   }
 
-  static float Score(GameState const& game) {
-    float p0_score = game.GetScore(0) + game.GetSun(0) / 3;
-    float p1_score = game.GetScore(1) + game.GetSun(1) / 3;
+ protected:
+  /**
+   * Agent::Rand on the calling thread, a per thread engine on workers.
+   */
+  int Rand() {
+    if (worker_rand_) {
+      return std::uniform_int_distribution<int>{0, RAND_MAX}(*worker_rand_);
+    }
+    return Agent::Rand();
+  }
 
+  static float Score(float p0_score, float p1_score) {
     if (p0_score > p1_score) {
       float diff = p0_score - p1_score;
 
@@ -330,13 +963,6 @@ class Mcts : public engine::Agent {
       return 0.0f;
     }
   }
-
-  static void Backup(std::vector<Node*> const& path, float score) {
-    for (auto it = path.rbegin(); it != path.rend(); ++it) {
-      (*it)->n_rollouts++;
-      (*it)->score += score;
-    }
-  }
 };
 }  // namespace agent
 
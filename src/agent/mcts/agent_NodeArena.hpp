@@ -0,0 +1,178 @@
+#ifndef __INCLUDE_GUARD_AGENT_NODEARENA_HPP
+#define __INCLUDE_GUARD_AGENT_NODEARENA_HPP
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "util_General.hpp"
+
+namespace agent {
+
+/**
+ * Pool of tree nodes addressed by 32-bit indices. Node must have uint32_t
+ * first_child and next_sibling links, children form a singly linked list.
+ *
+ * Nodes live in fixed size chunks so references stay valid while the arena
+ * grows. Released subtrees are not walked: their roots go on a free list and
+ * a node's children only join the list when the node itself is reused.
+ *
+ * Allocate, AddChild and Release may be called from several search threads,
+ * Reroot and Clear only while no search runs.
+ *
+ * With a budget the arena reports IsFull once every free node is used and
+ * budget nodes exist, the owner is expected to Release subtrees then. It
+ * still grows past the budget if asked to.
+ */
+template <class Node>
+class NodeArena {
+ public:
+  static uint32_t constexpr kNull = 0xFFFFFFFFu;
+
+  NodeArena() {
+    pthread_mutex_init(&mutex_, nullptr);
+    /* Never reallocated, readers index it while Allocate appends. */
+    chunks_.reserve(kMaxChunks);
+  }
+  ~NodeArena() { pthread_mutex_destroy(&mutex_); }
+
+  NodeArena(NodeArena const&) = delete;
+  NodeArena& operator=(NodeArena const&) = delete;
+
+  Node& operator[](uint32_t i) {
+    ASSERT(i < size_);
+    return chunks_[i >> kChunkBits][i & kChunkMask];
+  }
+  Node const& operator[](uint32_t i) const {
+    ASSERT(i < size_);
+    return chunks_[i >> kChunkBits][i & kChunkMask];
+  }
+
+  /**
+   * Index of a node for the caller to fill in. A new node is default
+   * constructed, a reused one still holds the released node so whatever it
+   * owned can be recycled.
+   */
+  uint32_t Allocate() {
+    pthread_mutex_lock(&mutex_);
+    uint32_t i;
+    if (!free_.empty()) {
+      i = free_.back();
+      free_.pop_back();
+      for (uint32_t c = (*this)[i].first_child; c != kNull;
+           c = (*this)[c].next_sibling) {
+        free_.push_back(c);
+      }
+    } else {
+      if ((size_ >> kChunkBits) == chunks_.size()) {
+        /* Growing chunks_ past its reserve would move it under readers. */
+        if (chunks_.size() >= kMaxChunks) {
+          pthread_mutex_unlock(&mutex_);
+          throw std::length_error("NodeArena: out of chunks");
+        }
+        chunks_.emplace_back(new Node[kChunkSize]);
+      }
+      i = size_++;
+      chunks_[i >> kChunkBits][i & kChunkMask] = Node();
+    }
+    UpdateFull();
+    pthread_mutex_unlock(&mutex_);
+
+    return i;
+  }
+
+  /**
+   * Releases the subtree rooted at i, which must not be linked from any
+   * other node.
+   */
+  void Release(uint32_t i) {
+    pthread_mutex_lock(&mutex_);
+    free_.push_back(i);
+    UpdateFull();
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /**
+   * Nodes the arena should hold at most, 0 for no limit.
+   */
+  void SetBudget(size_t budget) {
+    budget_ = budget;
+    UpdateFull();
+  }
+
+  bool IsFull() const { return __atomic_load_n(&full_, __ATOMIC_RELAXED); }
+
+  /**
+   * Prepends child to parent's children. The child is fully written before
+   * other threads can reach it.
+   */
+  void AddChild(uint32_t parent, uint32_t child) {
+    auto& head = (*this)[parent].first_child;
+    auto& next = (*this)[child].next_sibling;
+    next = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&head, &next, child, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  /**
+   * First child of parent, kNull if none, safe against a concurrent AddChild.
+   */
+  uint32_t GetFirstChild(uint32_t parent) const {
+    return __atomic_load_n(&(*this)[parent].first_child, __ATOMIC_ACQUIRE);
+  }
+
+  /**
+   * Releases root and every subtree below it except keep's, which becomes
+   * a root.
+   */
+  void Reroot(uint32_t root, uint32_t keep) {
+    for (uint32_t c = (*this)[root].first_child; c != kNull;
+         c = (*this)[c].next_sibling) {
+      if (c != keep) {
+        free_.push_back(c);
+      }
+    }
+    (*this)[root].first_child = kNull;
+    free_.push_back(root);
+    (*this)[keep].next_sibling = kNull;
+    UpdateFull();
+  }
+
+  /**
+   * Releases every node, keeping the chunks for reuse.
+   */
+  void Clear() {
+    size_ = 0u;
+    free_.clear();
+    UpdateFull();
+  }
+
+  /* Nodes handed out or waiting on the free list. */
+  size_t size() const { return size_; }
+
+ private:
+  static u_int constexpr kChunkBits = 14u;
+  static uint32_t constexpr kChunkSize = 1u << kChunkBits;
+  static uint32_t constexpr kChunkMask = kChunkSize - 1u;
+  static size_t constexpr kMaxChunks = 1u << 12;
+
+  void UpdateFull() {
+    __atomic_store_n(&full_, budget_ > 0u && size_ >= budget_ && free_.empty(),
+                     __ATOMIC_RELAXED);
+  }
+
+  std::vector<std::unique_ptr<Node[]>> chunks_;
+  std::vector<uint32_t> free_;
+  uint32_t size_{};
+  size_t budget_{};
+  bool full_{};
+  pthread_mutex_t mutex_;
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_NODEARENA_HPP */
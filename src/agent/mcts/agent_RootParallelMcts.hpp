@@ -0,0 +1,143 @@
+#ifndef __INCLUDE_GUARD_AGENT_ROOTPARALLELMCTS_HPP
+#define __INCLUDE_GUARD_AGENT_ROOTPARALLELMCTS_HPP
+
+#include <pthread.h>
+
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "agent_Mcts.hpp"
+#include "engine_Agent.hpp"
+#include "engine_GameState.hpp"
+#include "engine_Move.hpp"
+#include "util_General.hpp"
+#include "util_TimeStamp.hpp"
+
+namespace agent {
+
+/**
+ * Independent searches of the same position, one per thread, each with its
+ * own tree, arena and random engine so no node is shared. The move is chosen
+ * on the root statistics summed per move, then every tree advances to it and
+ * is reused next turn. Every search times its turns as if it had played
+ * them alone.
+ */
+template <class Search = Mcts>
+class RootParallelMcts : public engine::Agent {
+ public:
+  using GameState = engine::GameState;
+  using Move = engine::Move;
+  using TimeStamp = util::TimeStamp;
+
+  /**
+   * args are passed to the constructor of every search.
+   */
+  template <class... Args>
+  explicit RootParallelMcts(u_int n_searches, Args const&... args) {
+    ASSERT(n_searches > 0);
+    for (u_int i = 0; i < n_searches; ++i) {
+      searches_.push_back(std::make_unique<Search>(args...));
+    }
+  }
+
+  void Init() override {
+    Agent::Init();
+    for (auto& search : searches_) {
+      search->Init(GetArid());
+    }
+  }
+
+  Move ChooseMove(GameState const& state, TimeStamp const& start) override {
+    Move solved;
+    if (searches_[0]->SolveEndgame(state, start, solved)) {
+      for (auto& search : searches_) {
+        search->ResetHistory();
+      }
+      return solved;
+    }
+
+    std::vector<Worker> workers(searches_.size() - 1u);
+    for (size_t i = 0; i < workers.size(); ++i) {
+      workers[i] = Worker{searches_[i + 1u].get(), &state, &start};
+      pthread_create(&workers[i].thread, nullptr, RunWorker, &workers[i]);
+    }
+
+    searches_[0]->SearchRoot(state, start);
+
+    for (auto& worker : workers) {
+      pthread_join(worker.thread, nullptr);
+    }
+
+    Move best = MergeRoots();
+    for (auto& search : searches_) {
+      search->AdvanceRoot(best);
+    }
+    return best;
+  }
+
+ protected:
+  void EndTurn(double seconds) override {
+    for (auto& search : searches_) {
+      search->EndTurn(seconds);
+    }
+  }
+
+ private:
+  struct Worker {
+    Search* search;
+    GameState const* state;
+    TimeStamp const* start;
+    pthread_t thread{};
+  };
+
+  struct RootChild {
+    Move move;
+    uint64_t n_rollouts;
+    float score;
+  };
+
+  static void* RunWorker(void* ptr) {
+    Worker& worker = *static_cast<Worker*>(ptr);
+    worker.search->SearchRoot(*worker.state, *worker.start);
+    return nullptr;
+  }
+
+  /**
+   * Best mean score over the root children of every search, summed per move.
+   */
+  Move MergeRoots() const {
+    std::vector<RootChild> children;
+    for (auto const& search : searches_) {
+      search->ForEachRootChild(
+          [&](Move const& m, uint32_t n_rollouts, float score) {
+            for (auto& child : children) {
+              if (Move::ToInt(child.move) == Move::ToInt(m)) {
+                child.n_rollouts += n_rollouts;
+                child.score += score;
+                return;
+              }
+            }
+            children.push_back(RootChild{m, n_rollouts, score});
+          });
+    }
+
+    Move best = Move::Invalid();
+    float best_value = -FLT_MAX;
+    for (auto const& child : children) {
+      ASSERT(child.n_rollouts > 0);
+      if (child.score / child.n_rollouts > best_value) {
+        best = child.move;
+        best_value = child.score / child.n_rollouts;
+      }
+    }
+    return best;
+  }
+
+  std::vector<std::unique_ptr<Search>> searches_;
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_ROOTPARALLELMCTS_HPP */
@@ -0,0 +1,209 @@
+#ifndef __INCLUDE_GUARD_AGENT_SEARCHPROFILE_HPP
+#define __INCLUDE_GUARD_AGENT_SEARCHPROFILE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "util_General.hpp"
+#include "util_Profiler.hpp"
+#include "util_TimeStamp.hpp"
+
+namespace agent {
+
+/**
+ * Per turn profile of a search: cycles in each phase of a rollout, rollouts
+ * per second, tree size and depth, and how often the last turn's tree was
+ * reused. A turn is printed to stderr as one JSON line and, with
+ * SetTraceFile, added to a Chrome trace.
+ *
+ * Compiled in by util::ENABLE_PROFILING, otherwise every member does
+ * nothing.
+ */
+class SearchProfile {
+ public:
+  using TimeStamp = util::TimeStamp;
+
+  enum Section : size_t { kSelect, kExpand, kHeuristic, kBackup, kSections };
+
+  /**
+   * Rollouts of one search thread, see AddRollouts.
+   */
+  class Rollouts {
+   public:
+    void Add(size_t depth) {
+      if constexpr (util::ENABLE_PROFILING) {
+        n_++;
+        depth_sum_ += depth;
+        depth_max_ = std::max<uint64_t>(depth_max_, depth);
+      }
+    }
+
+   private:
+    friend class SearchProfile;
+
+    uint64_t n_{};
+    uint64_t depth_sum_{};
+    uint64_t depth_max_{};
+  };
+
+  ~SearchProfile() {
+    if (trace_.is_open()) {
+      trace_ << "\n]\n";
+    }
+  }
+
+  /**
+   * Writes every turn from now on to a trace at path, for chrome://tracing
+   * or Perfetto.
+   */
+  void SetTraceFile(std::string const& path) {
+    if constexpr (util::ENABLE_PROFILING) {
+      trace_.open(path);
+      trace_ << "[";
+    }
+  }
+
+  /**
+   * Result of callable(), timed as section.
+   */
+  template <class Callable>
+  auto Time(Section section, Callable&& callable) {
+    util::ScopedTimer<util::Profiler<kSections>> timer(profiler_, section);
+    return callable();
+  }
+
+  void StartTurn() {
+    if constexpr (util::ENABLE_PROFILING) {
+      start_ = TimeStamp();
+      start_cycles_ = util::ReadCycles();
+      profiler_.Reset();
+      rollouts_ = Rollouts();
+    }
+  }
+
+  /**
+   * Counts a turn that had a tree from the last one, hit if it followed the
+   * game.
+   */
+  void RecordReuse(bool hit) {
+    if constexpr (util::ENABLE_PROFILING) {
+      n_tracked_++;
+      n_reused_ += hit;
+    }
+  }
+
+  /**
+   * Merges the rollouts of a search thread, safe to call concurrently.
+   */
+  void AddRollouts(Rollouts const& rollouts) {
+    if constexpr (util::ENABLE_PROFILING) {
+      util::AtomicAdd(rollouts_.n_, rollouts.n_);
+      util::AtomicAdd(rollouts_.depth_sum_, rollouts.depth_sum_);
+      uint64_t max = util::AtomicLoad(rollouts_.depth_max_);
+      while (rollouts.depth_max_ > max &&
+             !__atomic_compare_exchange_n(&rollouts_.depth_max_, &max,
+                                          rollouts.depth_max_, true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED)) {
+      }
+    }
+  }
+
+  /**
+   * Reports the turn on day, the tree holding n_nodes in n_bytes.
+   */
+  void EndTurn(uint8_t day, size_t n_nodes, size_t n_bytes) {
+    if constexpr (util::ENABLE_PROFILING) {
+      double seconds = start_.Since();
+      double cycles_per_second =
+          (util::ReadCycles() - start_cycles_) / std::max(seconds, 1e-9);
+
+      std::array<double, kSections> section_seconds;
+      for (size_t s = 0; s < kSections; ++s) {
+        section_seconds[s] = profiler_.Get(s) / cycles_per_second;
+      }
+      uint64_t n = rollouts_.n_;
+      double depth_avg =
+          n > 0u ? static_cast<double>(rollouts_.depth_sum_) / n : 0.0;
+      double reuse_rate =
+          n_tracked_ > 0u ? static_cast<double>(n_reused_) / n_tracked_ : 0.0;
+
+      std::fprintf(
+          stderr,
+          "{\"turn\": %u, \"day\": %u, \"seconds\": %.6f, \"rollouts\": %llu, "
+          "\"rollouts_per_second\": %.1f, \"select\": %.6f, \"expand\": "
+          "%.6f, \"heuristic\": %.6f, \"backup\": %.6f, \"nodes\": %zu, "
+          "\"bytes\": %zu, \"depth_avg\": %.2f, \"depth_max\": %llu, "
+          "\"reuse_rate\": %.3f}\n",
+          n_turns_, static_cast<u_int>(day), seconds,
+          static_cast<unsigned long long>(n), n / std::max(seconds, 1e-9),
+          section_seconds[kSelect], section_seconds[kExpand],
+          section_seconds[kHeuristic], section_seconds[kBackup], n_nodes,
+          n_bytes, depth_avg,
+          static_cast<unsigned long long>(rollouts_.depth_max_), reuse_rate);
+
+      if (trace_.is_open()) {
+        WriteTrace(day, seconds, section_seconds, n_nodes, n);
+      }
+      n_turns_++;
+    }
+  }
+
+ private:
+  static constexpr std::array<char const*, kSections> kSectionNames = {
+      "Select", "Expand", "Heuristic", "Backup"};
+
+  /**
+   * The turn as a slice on thread 0 and the seconds of each section, summed
+   * over search threads, as consecutive slices on thread 1.
+   */
+  void WriteTrace(uint8_t day, double seconds,
+                  std::array<double, kSections> const& section_seconds,
+                  size_t n_nodes, uint64_t n_rollouts) {
+    double ts = (start_ - origin_) * 1e6;
+    WriteEvent();
+    trace_ << "{\"name\": \"turn " << n_turns_
+           << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": " << ts
+           << ", \"dur\": " << seconds * 1e6
+           << ", \"args\": {\"day\": " << static_cast<u_int>(day)
+           << ", \"rollouts\": " << n_rollouts << "}}";
+
+    double section_ts = ts;
+    for (size_t s = 0; s < kSections; ++s) {
+      WriteEvent();
+      trace_ << "{\"name\": \"" << kSectionNames[s]
+             << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": 1, \"ts\": "
+             << section_ts << ", \"dur\": " << section_seconds[s] * 1e6
+             << "}";
+      section_ts += section_seconds[s] * 1e6;
+    }
+
+    WriteEvent();
+    trace_ << "{\"name\": \"tree\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << ts
+           << ", \"args\": {\"nodes\": " << n_nodes << "}}";
+    trace_.flush();
+  }
+
+  void WriteEvent() {
+    trace_ << (n_events_++ > 0u ? ",\n" : "\n");
+  }
+
+  util::Profiler<kSections> profiler_;
+  Rollouts rollouts_;
+  TimeStamp origin_;
+  TimeStamp start_;
+  uint64_t start_cycles_{};
+  u_int n_turns_{};
+  uint64_t n_tracked_{};
+  uint64_t n_reused_{};
+  uint64_t n_events_{};
+  std::ofstream trace_;
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_SEARCHPROFILE_HPP */
@@ -0,0 +1,125 @@
+#ifndef __INCLUDE_GUARD_AGENT_TIMEMANAGER_HPP
+#define __INCLUDE_GUARD_AGENT_TIMEMANAGER_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include "util_TimeStamp.hpp"
+
+namespace agent {
+
+/**
+ * Search budget of a turn.
+ *
+ * The referee gives kFirstTurnSeconds to the first turn and kTurnSeconds to
+ * every other one, unused time is lost. A turn gets the part of that limit
+ * its day and number of moves are worth, and ends earlier once the most
+ * visited root child can no longer be overtaken in the rollouts left. Time
+ * saved goes to pondering, which searches the next turn's positions.
+ *
+ * With a rollout budget the clock is ignored and turns stop at that many
+ * root rollouts instead, so searches are reproducible on any machine.
+ */
+class TimeManager {
+ public:
+  using TimeStamp = util::TimeStamp;
+
+  static double constexpr kFirstTurnSeconds = 1.0;
+  static double constexpr kTurnSeconds = 0.1;
+
+  /**
+   * max_rollouts > 0 budgets turns in root rollouts rather than seconds.
+   */
+  explicit TimeManager(uint32_t max_rollouts = 0u)
+      : max_rollouts_(max_rollouts) {}
+
+  /**
+   * Plans a turn on day with n_moves root moves, the root already holding
+   * n_rollouts from earlier turns.
+   */
+  void StartTurn(uint8_t day, size_t n_moves, bool first_turn,
+                 uint32_t n_rollouts) {
+    first_rollouts_ = n_rollouts;
+
+    double limit = (first_turn ? kFirstTurnSeconds : kTurnSeconds) - margin_;
+    double share = day < kOpeningDays ? 0.8 : day < kEndgameDay ? 1.0 : 0.9;
+    if (n_moves <= 1u) {
+      share = 0.0;
+    } else if (n_moves < kFewMoves) {
+      share *= 0.5;
+    }
+    /* The first turn also warms up the tree for the whole game. */
+    target_seconds_ = first_turn ? limit : limit * share;
+    target_rollouts_ = static_cast<uint32_t>(max_rollouts_ * share);
+  }
+
+  /**
+   * Whether the search should stop, at n_rollouts root rollouts of which
+   * the most visited child leads the others by lead.
+   */
+  bool IsOver(TimeStamp const& start, uint32_t n_rollouts,
+              uint32_t lead) const {
+    uint32_t done = n_rollouts - first_rollouts_;
+    if (max_rollouts_ > 0u) {
+      return n_rollouts > std::max(target_rollouts_, 1u) ||
+             (done >= kMinRollouts && lead > target_rollouts_ - n_rollouts);
+    }
+
+    double elapsed = start.Since();
+    if (elapsed >= target_seconds_) {
+      return true;
+    }
+
+    if (done < kMinRollouts || elapsed < kMinShare * target_seconds_) {
+      return false;
+    }
+    double left = done / elapsed * (target_seconds_ - elapsed);
+    return lead > left;
+  }
+
+  /**
+   * Records that the turn planned by StartTurn wrote its move seconds after
+   * its start, the safety margin keeps the largest recent overshoot of the
+   * target.
+   */
+  void EndTurn(double seconds) {
+    if (max_rollouts_ > 0u) {
+      return;
+    }
+
+    double overshoot = std::max(seconds - target_seconds_, 0.0);
+    margin_ = std::max(kMinMargin + overshoot,
+                       margin_ + (kMinMargin + overshoot - margin_) * 0.1);
+    margin_ = std::min(margin_, kMaxMargin);
+  }
+
+  /* Whether it is worth computing the lead for IsOver at n_rollouts. */
+  static bool IsCheckpoint(uint32_t n_rollouts) {
+    return n_rollouts % kCheckInterval == 0u;
+  }
+
+ private:
+  /* Opening days have few trees to play, from kEndgameDay less is left to
+   * plan for. */
+  static uint8_t constexpr kOpeningDays = 6u;
+  static uint8_t constexpr kEndgameDay = 18u;
+  static size_t constexpr kFewMoves = 8u;
+
+  /* Early stops need kMinRollouts and kMinShare of the turn behind them. */
+  static uint32_t constexpr kMinRollouts = 256u;
+  static double constexpr kMinShare = 0.5;
+  static uint32_t constexpr kCheckInterval = 64u;
+
+  static double constexpr kMinMargin = 0.005;
+  static double constexpr kMaxMargin = 0.03;
+
+  uint32_t max_rollouts_;
+  uint32_t first_rollouts_{};
+  uint32_t target_rollouts_{};
+  double target_seconds_{kTurnSeconds};
+  double margin_{kMinMargin};
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_TIMEMANAGER_HPP */
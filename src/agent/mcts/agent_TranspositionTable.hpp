@@ -0,0 +1,114 @@
+#ifndef __INCLUDE_GUARD_AGENT_TRANSPOSITIONTABLE_HPP
+#define __INCLUDE_GUARD_AGENT_TRANSPOSITIONTABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "util_General.hpp"
+
+namespace agent {
+
+/**
+ * Fixed size table of search statistics keyed by GameState::Hash(), so
+ * positions reached through different move orders share their rollouts.
+ *
+ * Entries live in cache line sized buckets of 4. When a bucket is full the
+ * entry with the fewest rollouts is replaced.
+ *
+ * Every field is read and written atomically without a lock. Insert claims
+ * an entry by swapping its key for kClaimed, clears the statistics and then
+ * publishes the new key, so a reader should check the key again after the
+ * statistics. Statistics added to an entry while it is claimed for another
+ * key are counted for that key.
+ */
+class TranspositionTable {
+ public:
+  struct Entry {
+    uint64_t key;
+    uint32_t n_rollouts;
+    float score;
+  };
+
+  /**
+   * n_entries is rounded down to a power of two number of buckets, 0
+   * disables the table.
+   */
+  explicit TranspositionTable(size_t n_entries = 0u) {
+    size_t n_buckets = n_entries / kBucketSize;
+    if (n_buckets == 0u) {
+      return;
+    }
+
+    while (n_buckets & (n_buckets - 1u)) {
+      n_buckets &= n_buckets - 1u;
+    }
+
+    buckets_.resize(n_buckets);
+    mask_ = n_buckets - 1u;
+    Clear();
+  }
+
+  bool IsEnabled() const { return !buckets_.empty(); }
+
+  void Clear() {
+    for (auto& bucket : buckets_) {
+      bucket.entries.fill(Entry{0u, 0u, 0.0f});
+    }
+  }
+
+  /**
+   * Entry for key, claiming one (and dropping its statistics) if key is not
+   * stored. Two threads inserting the same key at once may claim an entry
+   * each, a later Insert returns the first.
+   */
+  Entry& Insert(uint64_t key) {
+    auto& entries = buckets_[key & mask_].entries;
+
+    while (true) {
+      Entry* victim = nullptr;
+      uint64_t victim_key = 0u;
+      uint32_t fewest = 0u;
+      for (auto& e : entries) {
+        uint64_t e_key = __atomic_load_n(&e.key, __ATOMIC_ACQUIRE);
+        if (e_key == key) {
+          return e;
+        }
+        uint32_t n_rollouts = util::AtomicLoad(e.n_rollouts);
+        if (e_key != kClaimed && (!victim || n_rollouts < fewest)) {
+          victim = &e;
+          victim_key = e_key;
+          fewest = n_rollouts;
+        }
+      }
+
+      /* Retry if every entry is being claimed or the victim was taken. */
+      if (victim && __atomic_compare_exchange_n(&victim->key, &victim_key,
+                                                kClaimed, false,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED)) {
+        __atomic_store_n(&victim->n_rollouts, 0u, __ATOMIC_RELAXED);
+        util::AtomicStore(victim->score, 0.0f);
+        __atomic_store_n(&victim->key, key, __ATOMIC_RELEASE);
+        return *victim;
+      }
+    }
+  }
+
+ private:
+  static size_t constexpr kBucketSize = 4u;
+  /* Key of an entry while Insert clears it, no position hashes to it in
+   * practice. */
+  static uint64_t constexpr kClaimed = UINT64_MAX;
+
+  struct alignas(64) Bucket {
+    std::array<Entry, kBucketSize> entries;
+  };
+
+  std::vector<Bucket> buckets_;
+  uint64_t mask_{};
+};
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_TRANSPOSITIONTABLE_HPP */
@@ -0,0 +1,343 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "agent_BatchMcts.hpp"
+#include "agent_Mcts.hpp"
+#include "agent_NeuralMcts.hpp"
+#include "agent_RootParallelMcts.hpp"
+#include "engine_Referee.hpp"
+#include "util_TimeStamp.hpp"
+
+/**
+ * Tree parallel Mcts scaling benchmark.
+ *
+ * Plays self play games at each thread count with the normal turn time and
+ * reports rollouts per second over the turns searched by Mcts, the solved
+ * endgame turns are left out. The sweep runs without and then with the
+ * transposition table, then with RootParallelMcts running one tree per
+ * thread. BatchMcts, which scores each leaf with the mean of
+ * several lockstep rollouts, then plays on one thread and reports rollout
+ * games per second.
+ *
+ * Then plays NeuralMcts self play games, on its rollout budget, at each leaf
+ * batch size and reports network evaluations per second of search and of
+ * HeuristicBatch alone.
+ *
+ * Usage: bench_mcts.exe [--games 1]
+ */
+
+namespace {
+
+static std::vector<u_int> const THREADS = {1u, 2u, 4u, 8u, 16u};
+/* Transposition entries of the mcts_table_threads_N sweep, 16 MB. */
+static size_t constexpr TABLE_ENTRIES = 1u << 20;
+static size_t constexpr BATCH_LANES = 8u;
+static std::vector<u_int> const LEAF_BATCHES = {1u, 2u, 4u, 8u, 16u, 32u, 64u};
+
+/* Turns from this day on may be answered by the endgame solver. */
+static uint8_t constexpr LAST_SEARCH_DAY = 21u;
+
+struct Counters {
+  std::atomic<uint64_t> n_rollouts{};
+  double seconds{};
+  double heuristic_seconds{};
+};
+
+/**
+ * Rollouts counted on the current thread, added to counters when the thread
+ * ends or on Flush, so search threads do not contend on one counter inside
+ * the scaling they measure.
+ */
+struct ThreadCount {
+  Counters* counters{};
+  uint64_t n_rollouts{};
+
+  ~ThreadCount() { Flush(); }
+
+  void Flush() {
+    if (counters) {
+      counters->n_rollouts += n_rollouts;
+    }
+    n_rollouts = 0u;
+  }
+};
+
+static thread_local ThreadCount thread_count;
+
+template <class Search = agent::Mcts>
+class CountingMcts : public Search {
+ public:
+  using GameState = engine::GameState;
+  using Move = engine::Move;
+  using TimeStamp = util::TimeStamp;
+
+  /**
+   * Each leaf is counted as games_per_leaf rollouts.
+   */
+  CountingMcts(size_t table_entries, u_int n_threads, u_int games_per_leaf,
+               Counters* counters)
+      : Search(table_entries, n_threads),
+        games_per_leaf_(games_per_leaf),
+        counters_(counters) {}
+
+  float Heuristic(GameState const& gs) override {
+    if (counting_) {
+      thread_count.counters = counters_;
+      thread_count.n_rollouts += games_per_leaf_;
+    }
+    return Search::Heuristic(gs);
+  }
+
+  Move ChooseMove(GameState const& state, TimeStamp const& start) override {
+    counting_ = state.GetDay() <= LAST_SEARCH_DAY;
+    TimeStamp search_start;
+    Move m = Search::ChooseMove(state, start);
+    if (counting_) {
+      counters_->seconds += search_start.Since();
+    }
+    /* The workers flushed theirs as they ended. */
+    thread_count.Flush();
+    return m;
+  }
+
+ private:
+  u_int games_per_leaf_;
+  Counters* counters_;
+  bool counting_{};
+};
+
+/**
+ * Mcts counting its leaves while *counting, as a search of
+ * CountingRootParallelMcts.
+ */
+class CountingSearch : public agent::Mcts {
+ public:
+  CountingSearch(Counters* counters, bool const* counting)
+      : counters_(counters), counting_(counting) {}
+
+  float Heuristic(GameState const& gs) override {
+    if (*counting_) {
+      thread_count.counters = counters_;
+      thread_count.n_rollouts++;
+    }
+    return Mcts::Heuristic(gs);
+  }
+
+ private:
+  Counters* counters_;
+  bool const* counting_;
+};
+
+class CountingRootParallelMcts
+    : public agent::RootParallelMcts<CountingSearch> {
+ public:
+  CountingRootParallelMcts(u_int n_searches, Counters* counters)
+      : RootParallelMcts(n_searches, counters, &counting_),
+        counters_(counters) {}
+
+  Move ChooseMove(GameState const& state, TimeStamp const& start) override {
+    counting_ = state.GetDay() <= LAST_SEARCH_DAY;
+    TimeStamp search_start;
+    Move m = RootParallelMcts::ChooseMove(state, start);
+    if (counting_) {
+      counters_->seconds += search_start.Since();
+    }
+    thread_count.Flush();
+    return m;
+  }
+
+ private:
+  Counters* counters_;
+  bool counting_{};
+};
+
+class CountingRootParallelFactory : public engine::IAgentFactory {
+ public:
+  CountingRootParallelFactory(u_int n_searches, Counters* counters)
+      : n_searches_(n_searches), counters_(counters) {}
+
+  std::unique_ptr<engine::Agent> MakeAgent() const override {
+    return std::make_unique<CountingRootParallelMcts>(n_searches_,
+                                                      counters_);
+  }
+
+ private:
+  u_int n_searches_;
+  Counters* counters_;
+};
+
+class CountingNeuralMcts : public agent::NeuralMcts {
+ public:
+  CountingNeuralMcts(agent::NeuralHeuristic const* network, u_int leaf_batch,
+                     Counters* counters)
+      : NeuralMcts(network, 0.0f), counters_(counters) {
+    SetLeafBatch(leaf_batch);
+  }
+
+  void HeuristicBatch(std::vector<GameState const*> const& leaves,
+                      float* scores) override {
+    TimeStamp start;
+    NeuralMcts::HeuristicBatch(leaves, scores);
+    if (counting_) {
+      counters_->heuristic_seconds += start.Since();
+      counters_->n_rollouts += leaves.size();
+    }
+  }
+
+  Move ChooseMove(GameState const& state, TimeStamp const& start) override {
+    counting_ = state.GetDay() <= LAST_SEARCH_DAY;
+    TimeStamp search_start;
+    Move m = NeuralMcts::ChooseMove(state, start);
+    if (counting_) {
+      counters_->seconds += search_start.Since();
+    }
+    return m;
+  }
+
+ private:
+  Counters* counters_;
+  bool counting_{};
+};
+
+class CountingNeuralFactory : public engine::IAgentFactory {
+ public:
+  CountingNeuralFactory(agent::NeuralHeuristic const* network,
+                        u_int leaf_batch, Counters* counters)
+      : network_(network), leaf_batch_(leaf_batch), counters_(counters) {}
+
+  std::unique_ptr<engine::Agent> MakeAgent() const override {
+    return std::make_unique<CountingNeuralMcts>(network_, leaf_batch_,
+                                                counters_);
+  }
+
+ private:
+  agent::NeuralHeuristic const* network_;
+  u_int leaf_batch_;
+  Counters* counters_;
+};
+
+template <class Search = agent::Mcts>
+class CountingFactory : public engine::IAgentFactory {
+ public:
+  CountingFactory(size_t table_entries, u_int n_threads, Counters* counters,
+                  u_int games_per_leaf = 1u)
+      : table_entries_(table_entries),
+        n_threads_(n_threads),
+        games_per_leaf_(games_per_leaf),
+        counters_(counters) {}
+
+  std::unique_ptr<engine::Agent> MakeAgent() const override {
+    return std::make_unique<CountingMcts<Search>>(
+        table_entries_, n_threads_, games_per_leaf_, counters_);
+  }
+
+ private:
+  size_t table_entries_;
+  u_int n_threads_;
+  u_int games_per_leaf_;
+  Counters* counters_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  u_int n_games = 1u;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--games") == 0) {
+      n_games = std::stoi(argv[i + 1]);
+    } else {
+      std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::printf("{\n  \"benchmarks\": [\n");
+  for (size_t table_entries : {size_t{0u}, TABLE_ENTRIES}) {
+    double base_rate = 0.0;
+    for (size_t t = 0; t < THREADS.size(); ++t) {
+      Counters counters;
+      CountingFactory<> factory(table_entries, THREADS[t], &counters);
+      for (u_int g = 0; g < n_games; ++g) {
+        engine::Referee::CollectEpisode(factory, factory);
+      }
+
+      double rate = counters.n_rollouts / counters.seconds;
+      if (t == 0) {
+        base_rate = rate;
+      }
+      std::printf(
+          "    {\"name\": \"mcts_%sthreads_%u\", \"count\": %llu, "
+          "\"seconds\": %.6f, \"rate\": %.1f, \"speedup\": %.2f},\n",
+          table_entries > 0u ? "table_" : "", THREADS[t],
+          static_cast<unsigned long long>(counters.n_rollouts),
+          counters.seconds, rate, rate / base_rate);
+      std::fflush(stdout);
+    }
+  }
+
+  double base_rate = 0.0;
+  for (size_t t = 0; t < THREADS.size(); ++t) {
+    Counters counters;
+    CountingRootParallelFactory factory(THREADS[t], &counters);
+    for (u_int g = 0; g < n_games; ++g) {
+      engine::Referee::CollectEpisode(factory, factory);
+    }
+
+    double rate = counters.n_rollouts / counters.seconds;
+    if (t == 0) {
+      base_rate = rate;
+    }
+    std::printf(
+        "    {\"name\": \"mcts_root_threads_%u\", \"count\": %llu, "
+        "\"seconds\": %.6f, \"rate\": %.1f, \"speedup\": %.2f},\n",
+        THREADS[t], static_cast<unsigned long long>(counters.n_rollouts),
+        counters.seconds, rate, rate / base_rate);
+    std::fflush(stdout);
+  }
+
+  {
+    Counters counters;
+    CountingFactory<agent::BatchMcts<BATCH_LANES>> factory(
+        0u, 1u, &counters, BATCH_LANES);
+    for (u_int g = 0; g < n_games; ++g) {
+      engine::Referee::CollectEpisode(factory, factory);
+    }
+
+    std::printf(
+        "    {\"name\": \"batch_mcts_lanes_%u\", \"count\": %llu, "
+        "\"seconds\": %.6f, \"rate\": %.1f},\n",
+        static_cast<u_int>(BATCH_LANES),
+        static_cast<unsigned long long>(counters.n_rollouts),
+        counters.seconds, counters.n_rollouts / counters.seconds);
+    std::fflush(stdout);
+  }
+
+  /* Evaluation cost does not depend on the weights, untrained ones do. */
+  agent::NeuralHeuristic network;
+  for (size_t b = 0; b < LEAF_BATCHES.size(); ++b) {
+    Counters counters;
+    CountingNeuralFactory factory(&network, LEAF_BATCHES[b], &counters);
+    for (u_int g = 0; g < n_games; ++g) {
+      engine::Referee::CollectEpisode(factory, factory);
+    }
+
+    std::printf(
+        "    {\"name\": \"neural_leaf_batch_%u\", \"count\": %llu, "
+        "\"seconds\": %.6f, \"rate\": %.1f, \"heuristic_seconds\": %.6f, "
+        "\"heuristic_rate\": %.1f}%s\n",
+        LEAF_BATCHES[b], static_cast<unsigned long long>(counters.n_rollouts),
+        counters.seconds, counters.n_rollouts / counters.seconds,
+        counters.heuristic_seconds,
+        counters.n_rollouts / counters.heuristic_seconds,
+        b + 1 < LEAF_BATCHES.size() ? "," : "");
+    std::fflush(stdout);
+  }
+  std::printf("  ]\n}\n");
+
+  return 0;
+}
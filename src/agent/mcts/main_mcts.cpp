@@ -1,10 +1,12 @@
 #pragma GCC optimize "O3,omit-frame-pointer,inline"
+#pragma GCC target "avx2,bmi,bmi2,popcnt,fma"
 #include <iostream>
 
 #include "agent_Mcts.hpp"
 
 int main() {
   agent::Mcts agent;
+  agent.SetPondering(true);
   agent.SetStreams(std::cin, std::cout);
   agent.Init();
 
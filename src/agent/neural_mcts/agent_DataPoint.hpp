@@ -33,21 +33,6 @@ struct DataPoint {
   }
 };
 
-std::vector<DataPoint> LoadDataPoints(std::string const& fname) {
-  std::ifstream input;
-  input.open(fname);
-
-  std::vector<DataPoint> data;
-
-  while (!input.eof()) {
-    data.emplace_back(DataPoint::Deserialize(input));
-  }
-
-  input.close();
-
-  return data;
-}
-
 }  // namespace agent
 
 #endif /* __INCLUDE_GUARD_AGENT_DATAPOINT_HPP */
\ No newline at end of file
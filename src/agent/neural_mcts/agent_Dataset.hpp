@@ -0,0 +1,221 @@
+#ifndef __INCLUDE_GUARD_AGENT_DATASET_HPP
+#define __INCLUDE_GUARD_AGENT_DATASET_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "agent_DataPoint.hpp"
+#include "engine_GameRecord.hpp"
+#include "engine_GameState.hpp"
+
+namespace agent {
+
+/**
+ * DataPoints stored column by column in a memory mapped file: a header, then
+ * one 64 byte aligned array per GameState word, the arid masks and each
+ * byte field. Samples are read straight from the page cache, so opening a
+ * corpus costs nothing and shuffling is done on indices.
+ */
+class Dataset {
+ public:
+  static size_t constexpr kWordColumns = engine::GameState::kWords + 1u;
+  static size_t constexpr kByteColumns = 3u;
+
+  Dataset(Dataset const&) = delete;
+  Dataset& operator=(Dataset const&) = delete;
+  Dataset(Dataset&& other) { *this = std::move(other); }
+  Dataset& operator=(Dataset&& other) {
+    std::swap(data_, other.data_);
+    std::swap(length_, other.length_);
+    std::swap(header_, other.header_);
+    return *this;
+  }
+
+  ~Dataset() {
+    if (data_) {
+      munmap(data_, length_);
+    }
+  }
+
+  static Dataset Open(std::string const& fname) {
+    return Map(fname, O_RDONLY, PROT_READ, 0u);
+  }
+
+  /**
+   * New file of n_samples samples, to be filled with Set.
+   */
+  static Dataset Create(std::string const& fname, size_t n_samples) {
+    return Map(fname, O_RDWR | O_CREAT | O_TRUNC, PROT_READ | PROT_WRITE,
+               n_samples);
+  }
+
+  size_t size() const { return header_->n_samples; }
+
+  engine::GameState GetState(size_t i) const {
+    std::array<uint64_t, engine::GameState::kWords> words;
+    for (size_t w = 0; w < words.size(); ++w) {
+      words[w] = WordColumn(w)[i];
+    }
+    return engine::GameState::FromWords(words);
+  }
+
+  uint64_t GetArid(size_t i) const { return WordColumn(kAridColumn)[i]; }
+  uint8_t GetP0Score(size_t i) const { return ByteColumn(0)[i]; }
+  uint8_t GetP1Score(size_t i) const { return ByteColumn(1)[i]; }
+  uint8_t GetWinner(size_t i) const { return ByteColumn(2)[i]; }
+
+  DataPoint Get(size_t i) const {
+    return DataPoint{GetState(i), GetArid(i), GetP0Score(i), GetP1Score(i),
+                     GetWinner(i)};
+  }
+
+  void Set(size_t i, DataPoint const& d) {
+    auto words = d.state.ToWords();
+    for (size_t w = 0; w < words.size(); ++w) {
+      WordColumn(w)[i] = words[w];
+    }
+    WordColumn(kAridColumn)[i] = d.arid;
+    ByteColumn(0)[i] = d.p0_score;
+    ByteColumn(1)[i] = d.p1_score;
+    ByteColumn(2)[i] = d.winner;
+  }
+
+ private:
+  static uint64_t constexpr kMagic = 0x3153444F544F4850ull; /* "PHOTODS1" */
+  static size_t constexpr kAridColumn = engine::GameState::kWords;
+  static size_t constexpr kAlignment = 64u;
+
+  struct Header {
+    uint64_t magic;
+    uint64_t n_samples;
+    std::array<uint64_t, kWordColumns + kByteColumns> offsets;
+  };
+
+  Dataset() = default;
+
+  static size_t Align(size_t offset) {
+    return (offset + kAlignment - 1u) / kAlignment * kAlignment;
+  }
+
+  static Dataset Map(std::string const& fname, int flags, int protection,
+                     size_t n_samples) {
+    int fd = open(fname.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Can't open " + fname);
+    }
+
+    Header header = MakeHeader(n_samples);
+    size_t length = GetLength(header);
+
+    if (protection & PROT_WRITE) {
+      if (ftruncate(fd, length) != 0) {
+        close(fd);
+        throw std::runtime_error("Can't size " + fname);
+      }
+    } else {
+      length = lseek(fd, 0, SEEK_END);
+    }
+
+    Dataset dataset;
+    if (length >= sizeof(Header)) {
+      void* data = mmap(nullptr, length, protection, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        dataset.data_ = static_cast<uint8_t*>(data);
+        dataset.length_ = length;
+      }
+    }
+    close(fd);
+
+    if (!dataset.data_) {
+      throw std::runtime_error("Can't map " + fname);
+    }
+
+    dataset.header_ = reinterpret_cast<Header*>(dataset.data_);
+    if (protection & PROT_WRITE) {
+      *dataset.header_ = header;
+    } else {
+      auto const& stored = *dataset.header_;
+      if (stored.magic != kMagic ||
+          stored.offsets != MakeHeader(stored.n_samples).offsets ||
+          GetLength(stored) > length) {
+        throw std::runtime_error(fname + " is not a dataset");
+      }
+
+      /* Training reads samples in shuffled order. */
+      madvise(dataset.data_, dataset.length_, MADV_RANDOM);
+    }
+
+    return dataset;
+  }
+
+  static Header MakeHeader(size_t n_samples) {
+    Header header{kMagic, n_samples, {}};
+    size_t offset = Align(sizeof(Header));
+    for (size_t c = 0; c < header.offsets.size(); ++c) {
+      header.offsets[c] = offset;
+      offset += Align(n_samples * ColumnWidth(c));
+    }
+    return header;
+  }
+
+  static size_t GetLength(Header const& header) {
+    size_t last = header.offsets.size() - 1u;
+    return header.offsets[last] +
+           Align(header.n_samples * ColumnWidth(last));
+  }
+
+  static size_t ColumnWidth(size_t c) { return c < kWordColumns ? 8u : 1u; }
+
+  uint64_t* WordColumn(size_t c) const {
+    return reinterpret_cast<uint64_t*>(data_ + header_->offsets[c]);
+  }
+  uint8_t* ByteColumn(size_t c) const {
+    return data_ + header_->offsets[kWordColumns + c];
+  }
+
+  uint8_t* data_{};
+  size_t length_{};
+  Header* header_{};
+};
+
+/**
+ * Dataset with one sample per frame of every GameRecord in records_fname.
+ */
+inline void WriteDataset(std::string const& records_fname,
+                         std::string const& dataset_fname) {
+  engine::GameRecord record;
+
+  size_t n_samples = 0u;
+  engine::GameRecordReader count_reader(records_fname);
+  while (count_reader.Next(record)) {
+    n_samples += record.size();
+  }
+
+  auto dataset = Dataset::Create(dataset_fname, n_samples);
+
+  size_t i = 0u;
+  engine::GameRecordReader reader(records_fname);
+  while (reader.Next(record)) {
+    auto final_state = record.GetFinalState();
+    auto p0_score = final_state.GetScore(0) + final_state.GetSun(0) / 3;
+    auto p1_score = final_state.GetScore(1) + final_state.GetSun(1) / 3;
+
+    record.ForEachFrame([&](engine::Episode::Frame const& f) {
+      dataset.Set(i++, DataPoint{f.state, f.arid,
+                                 static_cast<uint8_t>(p0_score),
+                                 static_cast<uint8_t>(p1_score),
+                                 static_cast<uint8_t>(f.winner)});
+    });
+  }
+}
+
+}  // namespace agent
+
+#endif /* __INCLUDE_GUARD_AGENT_DATASET_HPP */
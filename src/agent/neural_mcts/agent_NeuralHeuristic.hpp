@@ -3,12 +3,15 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "agent_DataPoint.hpp"
+#include "agent_Dataset.hpp"
 #include "engine_GameState.hpp"
 #include "engine_Referee.hpp"
+#include "neural_FrozenNetwork.hpp"
 #include "neural_Linear.hpp"
 #include "neural_MeanSquareError.hpp"
 #include "neural_Network.hpp"
@@ -16,10 +19,44 @@
 
 namespace agent {
 
+/**
+ * Value of a position in [-1, 1] for player 0, from a Network trained on
+ * game outcomes.
+ *
+ * Evaluate runs a FrozenNetwork copy of the Network's weights when the
+ * Network has the default layers, so it does not allocate. Changing the
+ * weights through network() drops that copy until the next Freeze.
+ */
 class NeuralHeuristic {
  public:
-  static size_t constexpr kInputDimensions =
-      engine::N_TREES + engine::N_TREES + engine::N_TREES + 7;
+  /* Tree size, dormancy and arid of each cell, then kScalarFeatures. */
+  static size_t constexpr kBoardFeatures = 3u * engine::N_TREES;
+  static size_t constexpr kScalarFeatures = 7u;
+  static size_t constexpr kInputDimensions = kBoardFeatures + kScalarFeatures;
+
+  using FrozenNetwork = neural::FrozenNetwork<kInputDimensions, 32, 24, 16, 1>;
+
+  /**
+   * First layer output for the board features of the last position
+   * evaluated with it. Positions evaluated one after the other in a search
+   * differ in a few cells, so Evaluate only adds the weights of the cells
+   * that changed and of the scalar features before the upper layers.
+   *
+   * Each search thread needs its own.
+   */
+  class Accumulator {
+   private:
+    friend class NeuralHeuristic;
+
+    /* Recomputed from scratch this often against rounding drift. */
+    static u_int constexpr kRefreshInterval = 1024u;
+
+    alignas(32) std::array<float, FrozenNetwork::kAccumulatorDimensions> sums_;
+    engine::GameState state_;
+    uint64_t arid_{};
+    uint64_t generation_{};
+    u_int n_updates_{};
+  };
 
   NeuralHeuristic() {
     std::vector<std::unique_ptr<neural::ILayer>> layers;
@@ -32,16 +69,27 @@ class NeuralHeuristic {
     layers.emplace_back(std::make_unique<neural::Linear>(16, 1));
     network_ = std::make_unique<neural::Network>(
         std::move(layers), std::make_unique<neural::MeanSquareError>());
+    Freeze();
   }
 
   NeuralHeuristic(std::unique_ptr<neural::Network> network)
-      : network_(std::move(network)) {}
+      : network_(std::move(network)) {
+    Freeze();
+  }
 
   NeuralHeuristic(std::string const& fname)
       : network_(std::make_unique<neural::Network>(
-            neural::Network::LoadFromFile(fname))) {}
+            neural::Network::LoadFromFile(fname))) {
+    Freeze();
+  }
 
   float Evaluate(engine::GameState const& g, uint64_t arid) const {
+    if (frozen_) {
+      alignas(32) std::array<float, kInputDimensions> features;
+      NeuralHeuristic::ToFeatures(features.data(), g, arid);
+      return frozen_->Forward(features.data());
+    }
+
     neural::FloatTensor features(1, NeuralHeuristic::kInputDimensions);
     NeuralHeuristic::ToFeatures(features, 0, g, arid);
     return const_cast<neural::Network const*>(network_.get())
@@ -49,11 +97,66 @@ class NeuralHeuristic {
         .value();
   }
 
+  /**
+   * Evaluate, with the first layer updated in accumulator from the last
+   * position evaluated with it.
+   */
+  float Evaluate(engine::GameState const& g, uint64_t arid,
+                 Accumulator& accumulator) const {
+    if (!frozen_) {
+      return Evaluate(g, arid);
+    }
+
+    Update(accumulator, g, arid);
+    alignas(32) std::array<float, FrozenNetwork::kAccumulatorDimensions> sums =
+        accumulator.sums_;
+    std::array<float, kScalarFeatures> scalars;
+    ToScalarFeatures(scalars.data(), g);
+    for (u_int i = 0u; i < kScalarFeatures; ++i) {
+      frozen_->Accumulate(kBoardFeatures + i, scalars[i], sums.data());
+    }
+    return frozen_->ForwardAccumulator(sums.data());
+  }
+
+  /**
+   * Values of states through one Network::Forward of them all, whose matrix
+   * products get more efficient per row as the batch grows.
+   */
+  void Evaluate(std::vector<engine::GameState const*> const& states,
+                uint64_t arid, float* values) const {
+    neural::FloatTensor features(states.size(), kInputDimensions);
+    for (size_t r = 0; r < states.size(); ++r) {
+      ToFeatures(features, r, *states[r], arid);
+    }
+
+    auto output = const_cast<neural::Network const*>(network_.get())
+                      ->Forward(std::move(features));
+    for (size_t r = 0; r < states.size(); ++r) {
+      values[r] = output.Get(r);
+    }
+  }
+
+  /**
+   * Copies the Network's weights for Evaluate, not thread safe with it.
+   */
+  void Freeze() {
+    static uint64_t n_frozen = 0u;
+
+    frozen_.reset();
+    if (FrozenNetwork::Matches(*network_)) {
+      frozen_ = std::make_unique<FrozenNetwork>(*network_);
+      generation_ = util::AtomicAdd(n_frozen, uint64_t{1}) + 1u;
+    }
+  }
+
   std::unique_ptr<NeuralHeuristic> Clone() const {
     return std::make_unique<NeuralHeuristic>(network_->Clone());
   }
 
-  neural::Network& network() { return *network_; }
+  neural::Network& network() {
+    frozen_.reset();
+    return *network_;
+  }
   neural::Network const& network() const { return *network_; }
 
   static neural::FloatTensor ToFeatures(
@@ -67,46 +170,56 @@ class NeuralHeuristic {
     return result;
   }
 
-  static void ToFeatures(neural::FloatTensor& tensor, u_int r,
-                         engine::GameState const& g, uint64_t arid) {
-    size_t c = 0u;
-
-    for (u_int t = 0; t < engine::N_TREES; ++t) {
-      float tree_size = 0.0f;
-      for (u_int s = 0; s < 4; ++s) {
-        if (g.GetPlayerTrees(0, s) & engine::GetTree(t)) {
-          tree_size = (s + 1) * 0.25f;
-        } else if (g.GetPlayerTrees(1, s) & engine::GetTree(t)) {
-          tree_size = (s + 1) * -0.25f;
-        }
-      }
+  /**
+   * Features of the samples at indices[0, n) of data.
+   */
+  static neural::FloatTensor ToFeatures(Dataset const& data,
+                                        uint32_t const* indices, size_t n) {
+    neural::FloatTensor result(n, kInputDimensions);
 
-      tensor.Get(r, c++) = tree_size;
+    for (size_t r = 0; r < n; ++r) {
+      ToFeatures(result, r, data.GetState(indices[r]),
+                 data.GetArid(indices[r]));
     }
 
-    for (u_int t = 0; t < engine::N_TREES; ++t) {
-      if (g.GetDormant() & engine::GetTree(t)) {
-        tensor.Get(r, c++) = 1.0f;
-      } else {
-        tensor.Get(r, c++) = -1.0f;
-      }
+    return result;
+  }
+
+  /**
+   * ToFeatures with each frame seen through a random board symmetry, which
+   * leaves the outcome unchanged.
+   */
+  template <class Rand>
+  static neural::FloatTensor ToAugmentedFeatures(
+      std::vector<engine::Episode::Frame const*> const& data,
+      Rand&& rand_func) {
+    neural::FloatTensor result(data.size(), kInputDimensions);
+
+    for (size_t r = 0; r < data.size(); ++r) {
+      u_int symmetry = rand_func() % engine::N_SYMMETRIES;
+      ToFeatures(result, r, data[r]->state.Transform(symmetry),
+                 engine::TransformTrees(data[r]->arid, symmetry));
     }
 
+    return result;
+  }
+
+  static void ToFeatures(neural::FloatTensor& tensor, u_int r,
+                         engine::GameState const& g, uint64_t arid) {
+    ToFeatures(tensor.data() + r * kInputDimensions, g, arid);
+  }
+
+  /**
+   * Writes the kInputDimensions features of g to features.
+   */
+  static void ToFeatures(float* features, engine::GameState const& g,
+                         uint64_t arid) {
     for (u_int t = 0; t < engine::N_TREES; ++t) {
-      if (arid & engine::GetTree(t)) {
-        tensor.Get(r, c++) = 1.0f;
-      } else {
-        tensor.Get(r, c++) = -1.0f;
-      }
+      features[t] = TreeFeature(g, t);
+      features[engine::N_TREES + t] = DormantFeature(g, t);
+      features[2u * engine::N_TREES + t] = AridFeature(arid, t);
     }
-
-    tensor.Get(r, c++) = g.GetDay() / 24.0f - 0.5f;
-    tensor.Get(r, c++) = g.GetNutrients() / 20.0f - 0.5f;
-    tensor.Get(r, c++) = g.GetScore(0) / 100.0f - 0.5f;
-    tensor.Get(r, c++) = g.GetSun(0) / 40.0f - 0.5f;
-    tensor.Get(r, c++) = g.GetScore(1) / 100.0f - 0.5f;
-    tensor.Get(r, c++) = g.GetSun(1) / 40.0f - 0.5f;
-    tensor.Get(r, c++) = (g.GetDay() % 6) / 5.0 - 5.0;
+    ToScalarFeatures(features + kBoardFeatures, g);
   }
 
   static neural::FloatTensor ToExpected(
@@ -114,24 +227,117 @@ class NeuralHeuristic {
     neural::FloatTensor result(data.size(), 1);
 
     for (u_int r = 0; r < data.size(); ++r) {
-      switch (data[r]->winner) {
-        case 0:
-          result.Get(r, 0) = 1.0f;
-          break;
-        case 1:
-          result.Get(r, 0) = -1.0f;
-          break;
-        case 2:
-          result.Get(r, 0) = 0.0f;
-          break;
-      }
+      result.Get(r, 0) = WinnerValue(data[r]->winner);
+    }
+
+    return result;
+  }
+
+  static neural::FloatTensor ToExpected(Dataset const& data,
+                                        uint32_t const* indices, size_t n) {
+    neural::FloatTensor result(n, 1);
+
+    for (size_t r = 0; r < n; ++r) {
+      result.Get(r, 0) = WinnerValue(data.GetWinner(indices[r]));
     }
 
     return result;
   }
 
  private:
+  static float TreeFeature(engine::GameState const& g, u_int t) {
+    float tree_size = 0.0f;
+    for (u_int s = 0; s < 4; ++s) {
+      if (g.GetPlayerTrees(0, s) & engine::GetTree(t)) {
+        tree_size = (s + 1) * 0.25f;
+      } else if (g.GetPlayerTrees(1, s) & engine::GetTree(t)) {
+        tree_size = (s + 1) * -0.25f;
+      }
+    }
+    return tree_size;
+  }
+
+  static float DormantFeature(engine::GameState const& g, u_int t) {
+    return g.GetDormant() & engine::GetTree(t) ? 1.0f : -1.0f;
+  }
+
+  static float AridFeature(uint64_t arid, u_int t) {
+    return arid & engine::GetTree(t) ? 1.0f : -1.0f;
+  }
+
+  static void ToScalarFeatures(float* features, engine::GameState const& g) {
+    size_t c = 0u;
+    features[c++] = g.GetDay() / 24.0f - 0.5f;
+    features[c++] = g.GetNutrients() / 20.0f - 0.5f;
+    features[c++] = g.GetScore(0) / 100.0f - 0.5f;
+    features[c++] = g.GetSun(0) / 40.0f - 0.5f;
+    features[c++] = g.GetScore(1) / 100.0f - 0.5f;
+    features[c++] = g.GetSun(1) / 40.0f - 0.5f;
+    /* Mirrored boards see the sun turn the other way, 6 to 11. */
+    u_int direction = g.GetSunDirection(g.GetDay()) +
+                      (g.GetOrientation() >= 6u ? 6u : 0u);
+    features[c++] = direction / 5.0 - 5.0;
+  }
+
+  /**
+   * Brings accumulator from its last position to g, adding the board
+   * features of the cells whose tree or dormancy changed.
+   */
+  void Update(Accumulator& accumulator, engine::GameState const& g,
+              uint64_t arid) const {
+    float* sums = accumulator.sums_.data();
+    if (accumulator.generation_ != generation_ || accumulator.arid_ != arid ||
+        accumulator.n_updates_ >= Accumulator::kRefreshInterval) {
+      alignas(32) std::array<float, kInputDimensions> features;
+      ToFeatures(features.data(), g, arid);
+      frozen_->ResetAccumulator(sums);
+      for (u_int i = 0u; i < kBoardFeatures; ++i) {
+        frozen_->Accumulate(i, features[i], sums);
+      }
+
+      accumulator.arid_ = arid;
+      accumulator.generation_ = generation_;
+      accumulator.n_updates_ = 0u;
+      accumulator.state_ = g;
+      return;
+    }
+
+    engine::GameState const& last = accumulator.state_;
+    uint64_t trees = 0u;
+    for (u_int p = 0; p < 2; ++p) {
+      for (u_int s = 0; s < 4; ++s) {
+        trees |= g.GetPlayerTrees(p, s) ^ last.GetPlayerTrees(p, s);
+      }
+    }
+    engine::IterateTrees(trees, [&](u_int t) {
+      frozen_->Accumulate(t, TreeFeature(g, t) - TreeFeature(last, t), sums);
+    });
+
+    uint64_t dormant = (g.GetDormant() ^ last.GetDormant()) & engine::TREE_MASK;
+    engine::IterateTrees(dormant, [&](u_int t) {
+      frozen_->Accumulate(engine::N_TREES + t,
+                          DormantFeature(g, t) - DormantFeature(last, t), sums);
+    });
+
+    accumulator.n_updates_++;
+    accumulator.state_ = g;
+  }
+
+  static float WinnerValue(u_int winner) {
+    switch (winner) {
+      case 0:
+        return 1.0f;
+      case 1:
+        return -1.0f;
+      default:
+        return 0.0f;
+    }
+  }
+
   std::unique_ptr<neural::Network> network_;
+  std::unique_ptr<FrozenNetwork> frozen_;
+  /* Tells Accumulators which FrozenNetwork they were computed with. */
+  uint64_t generation_{};
 };
 
 }  // namespace agent
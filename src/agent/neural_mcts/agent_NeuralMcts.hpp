@@ -9,15 +9,25 @@ namespace agent {
 class NeuralMcts : public Mcts {
  public:
   NeuralMcts(NeuralHeuristic const* network, float epsilon)
-      : Mcts(), network_(network), epsilon_(epsilon) {}
+      : Mcts(), network_(network), epsilon_(epsilon) {
+    SetTimeManager(TimeManager(kRollouts));
+  }
 
   float Heuristic(GameState const& gs) override {
-    return network_->Evaluate(gs, GetArid());
+    return network_->Evaluate(gs, GetArid(), accumulator_);
   }
 
-  bool CheckLimit(TimeStamp const& start, size_t n_rollouts,
-                  bool first_turn) override {
-    return n_rollouts > 1600;
+  /**
+   * A single leaf goes through the accumulator, more through one batched
+   * Network::Forward.
+   */
+  void HeuristicBatch(std::vector<GameState const*> const& leaves,
+                      float* scores) override {
+    if (leaves.size() == 1u) {
+      scores[0] = Heuristic(*leaves[0]);
+      return;
+    }
+    network_->Evaluate(leaves, GetArid(), scores);
   }
 
   Move ChooseMove(GameState const& state, TimeStamp const& start) override {
@@ -35,7 +45,12 @@ class NeuralMcts : public Mcts {
  private:
   float RandF() { return Rand() / static_cast<float>(RAND_MAX); }
 
+  /* Self play budget, in rollouts so data does not depend on the machine. */
+  static uint32_t constexpr kRollouts = 1600u;
+
   NeuralHeuristic const* network_;
+  /* Searches run on one thread at a time, pondering included. */
+  NeuralHeuristic::Accumulator accumulator_;
   float epsilon_;
 };
 }  // namespace agent
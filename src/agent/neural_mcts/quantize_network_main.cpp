@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <utility>
+
+#include "agent_Dataset.hpp"
+#include "agent_NeuralHeuristic.hpp"
+
+/**
+ * Post training quantization of a NeuralHeuristic network.
+ *
+ * Calibrates each layer's input range on a random subset of a dataset,
+ * saves the quantized network and reports how far its outputs are from the
+ * float network's on other samples of the dataset.
+ *
+ * Usage: quantize_network.exe model.bin data.ds quantized.bin
+ *            [--calibration 8192] [--eval 65536] [--bits 8|16]
+ */
+
+size_t constexpr EVAL_BATCH_SIZE = 8192;
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    std::cerr << "usage: " << argv[0]
+              << " model.bin data.ds quantized.bin [--calibration n]"
+                 " [--eval n] [--bits 8|16]"
+              << std::endl;
+    return 2;
+  }
+  size_t n_calibration = 8192u;
+  size_t n_eval = 65536u;
+  u_int bits = 8u;
+  for (int i = 4; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--calibration") == 0) {
+      n_calibration = std::stoul(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--eval") == 0) {
+      n_eval = std::stoul(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--bits") == 0) {
+      bits = std::stoul(argv[i + 1]);
+    } else {
+      std::cerr << "unknown argument " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+
+  auto network = neural::Network::LoadFromFile(argv[1]);
+  auto data = agent::Dataset::Open(argv[2]);
+
+  /* Calibration and evaluation samples are disjoint. */
+  std::vector<uint32_t> indices(data.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+  std::shuffle(indices.begin(), indices.end(), std::default_random_engine{1});
+  n_calibration = std::min(n_calibration, indices.size());
+  n_eval = std::min(n_eval, indices.size() - n_calibration);
+  uint32_t const* eval = indices.data() + n_calibration;
+
+  auto calibration =
+      agent::NeuralHeuristic::ToFeatures(data, indices.data(), n_calibration);
+  if (bits != 8u && bits != 16u) {
+    std::cerr << "--bits must be 8 or 16" << std::endl;
+    return 2;
+  }
+  auto quantized = network.Quantize(calibration, bits);
+  quantized.SaveToFile(argv[3]);
+
+  double max_error = 0.0;
+  double error_sum = 0.0;
+  double float_loss = 0.0;
+  double quantized_loss = 0.0;
+  size_t n_agree = 0u;
+  for (size_t i = 0; i < n_eval; i += EVAL_BATCH_SIZE) {
+    size_t n = std::min(EVAL_BATCH_SIZE, n_eval - i);
+    auto input = agent::NeuralHeuristic::ToFeatures(data, eval + i, n);
+    auto expected = agent::NeuralHeuristic::ToExpected(data, eval + i, n);
+    auto float_output =
+        std::as_const(network).Forward(neural::FloatTensor(input));
+    auto quantized_output =
+        std::as_const(quantized).Forward(neural::FloatTensor(input));
+
+    for (u_int r = 0; r < n; ++r) {
+      double f = float_output.Get(r);
+      double q = quantized_output.Get(r);
+      double error = std::abs(f - q);
+      max_error = std::max(max_error, error);
+      error_sum += error;
+      float_loss += (f - expected.Get(r)) * (f - expected.Get(r));
+      quantized_loss += (q - expected.Get(r)) * (q - expected.Get(r));
+      n_agree += (f > 0.0) == (q > 0.0);
+    }
+  }
+
+  size_t n = std::max<size_t>(n_eval, 1u);
+  std::cout << "calibration samples: " << n_calibration << std::endl;
+  std::cout << "eval samples: " << n_eval << std::endl;
+  std::cout << "max |float - quantized|: " << max_error << std::endl;
+  std::cout << "mean |float - quantized|: " << error_sum / n << std::endl;
+  std::cout << "float rmse: " << std::sqrt(float_loss / n) << std::endl;
+  std::cout << "quantized rmse: " << std::sqrt(quantized_loss / n)
+            << std::endl;
+  std::cout << "same winner: " << static_cast<double>(n_agree) / n
+            << std::endl;
+}
@@ -1,14 +1,16 @@
 #include <algorithm>
+#include <numeric>
 #include <random>
 
-#include "agent_DataPoint.hpp"
+#include "agent_Dataset.hpp"
 #include "agent_NeuralHeuristic.hpp"
 
 size_t constexpr BATCH_SIZE = 128;
+size_t constexpr EVAL_BATCH_SIZE = 8192;
 float constexpr LEARN_RATE = 0.05f;
 
 int main() {
-  auto data = agent::LoadDataPoints("photosynthesis_expert_players.bin");
+  auto data = agent::Dataset::Open("photosynthesis_expert_players.ds");
 
   std::cout << "Data Loaded: " << data.size() << " samples" << std::endl;
   auto rand_fn = std::default_random_engine{std::random_device{}()};
@@ -17,10 +19,12 @@ int main() {
   std::cout << "Training count: " << training_count << std::endl;
   std::cout << "Eval count: " << (data.size() - training_count) << std::endl;
 
-  auto training = std::vector<agent::DataPoint>(data.begin(),
-                                                data.begin() + training_count);
-  auto eval =
-      std::vector<agent::DataPoint>(data.begin() + training_count, data.end());
+  /* Samples are only ever touched through these indices. */
+  std::vector<uint32_t> indices(data.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+  uint32_t* training = indices.data();
+  uint32_t const* eval = indices.data() + training_count;
+  size_t eval_count = data.size() - training_count;
 
   std::cout << "Data prepared." << std::endl;
 
@@ -30,34 +34,39 @@ int main() {
   std::cout << "Network prepared." << std::endl;
 
   for (size_t e = 0; true; ++e) {
-    std::shuffle(training.begin(), training.end(), rand_fn);
+    std::shuffle(training, training + training_count, rand_fn);
 
     float loss_sum = 0.0f;
     size_t n_batches = 0u;
 
     util::TimeStamp start;
-    for (size_t i = BATCH_SIZE; i < training.size(); i += BATCH_SIZE) {
-      agent::DataPoint const* batch = training.data() + i - BATCH_SIZE;
+    for (size_t i = BATCH_SIZE; i <= training_count; i += BATCH_SIZE) {
+      uint32_t const* batch = training + i - BATCH_SIZE;
 
-      auto input = agent::NeuralHeuristic::ToFeatures(batch, BATCH_SIZE);
-      auto expected = agent::NeuralHeuristic::ToExpected(batch, BATCH_SIZE);
+      auto input = agent::NeuralHeuristic::ToFeatures(data, batch, BATCH_SIZE);
+      auto expected =
+          agent::NeuralHeuristic::ToExpected(data, batch, BATCH_SIZE);
 
       auto loss = network.Batch(input, expected, LEARN_RATE);
       n_batches++;
       loss_sum += loss;
     }
 
-    auto input = agent::NeuralHeuristic::ToFeatures(eval.data(), eval.size());
-    auto expected =
-        agent::NeuralHeuristic::ToExpected(eval.data(), eval.size());
-    auto loss = network.Loss(input, expected);
+    float eval_loss = 0.0f;
+    for (size_t i = 0; i < eval_count; i += EVAL_BATCH_SIZE) {
+      size_t n = std::min(EVAL_BATCH_SIZE, eval_count - i);
+      auto input = agent::NeuralHeuristic::ToFeatures(data, eval + i, n);
+      auto expected = agent::NeuralHeuristic::ToExpected(data, eval + i, n);
+      eval_loss += network.Loss(input, expected) * n;
+    }
+    eval_loss /= std::max<size_t>(eval_count, 1u);
 
     std::cout << e << ": train=" << std::sqrt(loss_sum / n_batches)
-              << " eval=" << std::sqrt(loss) << " t=" << start.Since()
+              << " eval=" << std::sqrt(eval_loss) << " t=" << start.Since()
               << std::endl;
 
     if (e % 10 == 0) {
       network.SaveToFile("network_" + std::to_string(e) + ".bin");
     }
   }
-}
\ No newline at end of file
+}
@@ -1,34 +1,42 @@
 #include <fstream>
 #include <iostream>
 
-#include "agent_DataPoint.hpp"
+#include "agent_Dataset.hpp"
 #include "agent_Mcts.hpp"
+#include "engine_GameRecord.hpp"
 #include "test_Runner.hpp"
 
+class MctsFactory : public engine::IAgentFactory {
+ public:
+  std::unique_ptr<engine::Agent> MakeAgent() const override {
+    return std::make_unique<agent::Mcts>();
+  }
+};
+
 int main() {
-  std::ofstream data_stream;
-  data_stream.open("photosynthesis_expert_players.bin");
+  std::ofstream data_stream("photosynthesis_expert_players.rec",
+                            std::ios::binary);
 
-  size_t count = 0;
-  auto result = test::Test<agent::Mcts, agent::Mcts>(
-      8192, 16, 100,
-      [&](std::vector<engine::GameState> const& states, u_int p0_score,
-          u_int p1_score, u_int winner, uint64_t arid) {
-        for (auto const& s : states) {
-          agent::DataPoint d{s, arid, static_cast<uint8_t>(p0_score),
-                             static_cast<uint8_t>(p1_score),
-                             static_cast<uint8_t>(winner)};
+  MctsFactory factory;
+  auto episodes = test::Test(factory, factory, 8192, 16);
 
-          d.Serialize(data_stream);
-        }
+  size_t count = 0;
+  u_int wins[3] = {};
+  for (auto const& e : episodes) {
+    auto record = engine::GameRecord::FromEpisode(e);
+    record.Serialize(data_stream);
 
-        count += states.size();
-      });
+    wins[record.GetWinner()]++;
+    count += record.size();
+  }
 
   data_stream.close();
 
-  std::cout << result.n_games << std::endl;
-  std::cout << result.left_wins << std::endl;
-  std::cout << result.right_wins << std::endl;
+  agent::WriteDataset("photosynthesis_expert_players.rec",
+                      "photosynthesis_expert_players.ds");
+
+  std::cout << episodes.size() << std::endl;
+  std::cout << wins[0] << std::endl;
+  std::cout << wins[1] << std::endl;
   std::cout << count << std::endl;
-}
\ No newline at end of file
+}
@@ -23,13 +23,14 @@ class Agent {
 
   Move Turn() {
     util::TimeStamp start;
+    StartPondering();
     GameState state = GameState::FromStream(*input_, start, arid_);
+    StopPondering();
 
     Move move = ChooseMove(state, start);
 
-    // std::cerr << "D: " << start.Since() << std::endl;
-
     *output_ << move << std::endl;
+    EndTurn(start.Since());
     return move;
   }
 
@@ -39,6 +40,23 @@ class Agent {
   int Rand() { return dist_(rand_engine_); }
   uint64_t GetArid() const { return arid_; }
 
+ protected:
+  void SetArid(uint64_t arid) { arid_ = arid; }
+
+  /**
+   * Called around the blocking read of the next turn, an agent may think on
+   * other threads in between. StopPondering must not return before they are
+   * done.
+   */
+  virtual void StartPondering() {}
+  virtual void StopPondering() {}
+
+  /**
+   * Called once the move is written and flushed, seconds after the turn's
+   * input was read.
+   */
+  virtual void EndTurn(double seconds) {}
+
  private:
   std::istream* input_{};
   std::ostream* output_{};
@@ -0,0 +1,233 @@
+#ifndef __INCLUDE_GUARD_ENGINE_GAMERECORD_HPP
+#define __INCLUDE_GUARD_ENGINE_GAMERECORD_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "engine_GameState.hpp"
+#include "engine_Move.hpp"
+#include "engine_Referee.hpp"
+#include "util_General.hpp"
+
+namespace engine {
+
+/**
+ * An Episode stored as its start position, arid mask, winner and moves.
+ * Frames are rebuilt by replaying the moves through GameState::Turn, with a
+ * stored keyframe every kKeyframeInterval frames so frame k is never more
+ * than that many turns away.
+ *
+ * Frames follow the Referee: when neither player is waiting both players
+ * move from the same state, player 0's frame first.
+ */
+class GameRecord {
+ public:
+  static size_t constexpr kKeyframeInterval = 32u;
+
+  GameRecord() = default;
+
+  static GameRecord FromEpisode(Episode const& e) {
+    ASSERT(!e.episode.empty());
+
+    GameRecord record;
+    record.start_ = e.episode.front().state;
+    record.arid_ = e.episode.front().arid;
+    record.winner_ = static_cast<uint8_t>(e.episode.front().winner);
+    for (auto const& f : e.episode) {
+      record.moves_.push_back(Move::ToInt(f.move));
+    }
+
+    size_t next_keyframe = kKeyframeInterval;
+    record.Replay(0u, record.start_, record.moves_.size(),
+                  [&](size_t k, GameState const& g, Move const&, u_int player,
+                      bool is_turn_start) {
+                    ASSERT(g == e.episode[k].state);
+                    ASSERT(player == e.episode[k].player);
+                    if (is_turn_start && k >= next_keyframe) {
+                      record.keyframes_.emplace_back(k, g);
+                      next_keyframe = k + kKeyframeInterval;
+                    }
+                  });
+
+    return record;
+  }
+
+  size_t size() const { return moves_.size(); }
+  uint64_t GetArid() const { return arid_; }
+  u_int GetWinner() const { return winner_; }
+
+  Episode::Frame GetFrame(size_t k) const {
+    ASSERT(k < size());
+
+    size_t first = 0u;
+    GameState g = start_;
+    FindKeyframe(k, first, g);
+
+    Episode::Frame frame(g, Move::Invalid(), 0u, arid_);
+    frame.winner = winner_;
+    Replay(first, g, k + 1u,
+           [&](size_t i, GameState const& state, Move const& m, u_int player,
+               bool) {
+             if (i == k) {
+               frame.state = state;
+               frame.move = m;
+               frame.player = player;
+             }
+           });
+    return frame;
+  }
+
+  /**
+   * State once every move has been played.
+   */
+  GameState GetFinalState() const {
+    size_t first = 0u;
+    GameState g = start_;
+    FindKeyframe(size(), first, g);
+    return Replay(first, g, size(),
+                  [](size_t, GameState const&, Move const&, u_int, bool) {});
+  }
+
+  /**
+   * Streams every frame through callable(Episode::Frame const&).
+   */
+  template <class Callable>
+  void ForEachFrame(Callable&& callable) const {
+    Episode::Frame frame(start_, Move::Invalid(), 0u, arid_);
+    frame.winner = winner_;
+    Replay(0u, start_, size(),
+           [&](size_t, GameState const& state, Move const& m, u_int player,
+               bool) {
+             frame.state = state;
+             frame.move = m;
+             frame.player = player;
+             callable(static_cast<Episode::Frame const&>(frame));
+           });
+  }
+
+  Episode ToEpisode() const {
+    Episode e{};
+    e.episode.reserve(size());
+    ForEachFrame([&](Episode::Frame const& f) { e.episode.push_back(f); });
+    return e;
+  }
+
+  void Serialize(std::ostream& out) const {
+    uint16_t n_moves = static_cast<uint16_t>(moves_.size());
+    uint8_t n_keyframes = static_cast<uint8_t>(keyframes_.size());
+    out.write(reinterpret_cast<char const*>(&n_moves), sizeof(n_moves));
+    out.write(reinterpret_cast<char const*>(&n_keyframes),
+              sizeof(n_keyframes));
+    out.write(reinterpret_cast<char const*>(&winner_), sizeof(winner_));
+    out.write(reinterpret_cast<char const*>(&arid_), sizeof(arid_));
+    start_.Serialize(out);
+    out.write(reinterpret_cast<char const*>(moves_.data()),
+              n_moves * sizeof(uint16_t));
+    for (auto const& keyframe : keyframes_) {
+      uint16_t k = static_cast<uint16_t>(keyframe.first);
+      out.write(reinterpret_cast<char const*>(&k), sizeof(k));
+      keyframe.second.Serialize(out);
+    }
+  }
+
+  /**
+   * Reads the next record, returns false once the stream runs out.
+   */
+  static bool Deserialize(std::istream& in, GameRecord& record) {
+    uint16_t n_moves;
+    uint8_t n_keyframes;
+    if (!in.read(reinterpret_cast<char*>(&n_moves), sizeof(n_moves))) {
+      return false;
+    }
+    in.read(reinterpret_cast<char*>(&n_keyframes), sizeof(n_keyframes));
+    in.read(reinterpret_cast<char*>(&record.winner_), sizeof(record.winner_));
+    in.read(reinterpret_cast<char*>(&record.arid_), sizeof(record.arid_));
+    record.start_ = GameState::Deserialize(in);
+    record.moves_.resize(n_moves);
+    in.read(reinterpret_cast<char*>(record.moves_.data()),
+            n_moves * sizeof(uint16_t));
+    record.keyframes_.clear();
+    for (u_int i = 0; i < n_keyframes; ++i) {
+      uint16_t k;
+      in.read(reinterpret_cast<char*>(&k), sizeof(k));
+      record.keyframes_.emplace_back(k, GameState::Deserialize(in));
+    }
+    return static_cast<bool>(in);
+  }
+
+ private:
+  /**
+   * Latest keyframe at or before frame k, if any.
+   */
+  void FindKeyframe(size_t k, size_t& first, GameState& g) const {
+    for (auto const& keyframe : keyframes_) {
+      if (keyframe.first > k) {
+        break;
+      }
+      first = keyframe.first;
+      g = keyframe.second;
+    }
+  }
+
+  /**
+   * Calls callable(k, state, move, player, is_turn_start) for frames first
+   * to last - 1, first must start a turn and g be its state. Returns the state
+   * after the last turn played.
+   */
+  template <class Callable>
+  GameState Replay(size_t first, GameState g, size_t last,
+                   Callable&& callable) const {
+    size_t k = first;
+    while (k < last) {
+      if (!g.IsWaiting(0) && !g.IsWaiting(1)) {
+        ASSERT(k + 1u < size());
+        Move m0 = Move::FromInt(moves_[k]);
+        Move m1 = Move::FromInt(moves_[k + 1u]);
+        callable(k, g, m0, 0u, true);
+        if (k + 1u < last) {
+          callable(k + 1u, g, m1, 1u, false);
+        }
+        g.Turn(0u, m0, arid_);
+        g.Turn(1u, m1, arid_);
+        k += 2u;
+      } else {
+        u_int player = g.NextPlayer();
+        Move m = Move::FromInt(moves_[k]);
+        callable(k, g, m, player, true);
+        g.Turn(player, m, arid_);
+        k += 1u;
+      }
+    }
+    return g;
+  }
+
+  GameState start_;
+  uint64_t arid_{};
+  uint8_t winner_{2u};
+  std::vector<uint16_t> moves_;
+  std::vector<std::pair<size_t, GameState>> keyframes_;
+};
+
+/**
+ * Streaming reader over a file of serialized GameRecords.
+ */
+class GameRecordReader {
+ public:
+  explicit GameRecordReader(std::string const& fname)
+      : input_(fname, std::ios::binary) {}
+
+  bool Next(GameRecord& record) {
+    return GameRecord::Deserialize(input_, record);
+  }
+
+ private:
+  std::ifstream input_;
+};
+
+}  // namespace engine
+
+#endif /* __INCLUDE_GUARD_ENGINE_GAMERECORD_HPP */
@@ -31,12 +31,16 @@ void GameState::ReadBoard(std::istream& input, uint64_t& arid) {
 }
 
 GameState GameState::RandomStart(uint64_t& arid) {
+  std::random_device rand_device;
+  return RandomStart(arid, rand_device());
+}
+
+GameState GameState::RandomStart(uint64_t& arid, uint32_t seed) {
   GameState g;
 
   arid = 0u;
 
-  std::random_device rand_device;
-  std::default_random_engine rand_engine(rand_device());
+  std::default_random_engine rand_engine(seed);
   std::uniform_int_distribution<int> uniform_dist(0, RAND_MAX);
   auto rand_func = [&]() -> int { return uniform_dist(rand_engine); };
 
@@ -198,87 +202,17 @@ GameState GameState::FromStream(std::istream& input, TimeStamp& start,
   }
 
   if constexpr (util::ENABLE_ASSERTS) {
-    MoveFilterParams params = MoveFilterParams::Default();
-    params.block_self_neighbor = false;
-    size_t expected_actions = 0;
-    g.GetMoves(
-        0,
-        [&](Move const& m) {
-          expected_actions++;
-          // std::cerr << m << std::endl;
-        },
-        arid, params);
-    ASSERT(n_actions == expected_actions);
+    ASSERT(n_actions == g.GetMoveSet<MoveFilter<false>>(0, arid).Count());
   }
 
   return g;
 }
 
-void GameState::GetMoves(u_int player,
-                         void (*callback)(Move const& m, void* data),
-                         void* data, uint64_t const& arid,
-                         MoveFilterParams const params) const {
-  if (IsTerminal()) {
-    return;
-  }
-
-  /* Can always wait. */
-  callback(Move::Wait(), data);
-
-  uint8_t sun = GetSun(player);
-
-  /* Get grow moves */
-  if (params.can_grow) {
-    for (u_int s = 0; s < 3; ++s) {
-      u_int n_trees = GetNumTrees(player, s + 1);
-      if (sun < n_trees + GetTreeFixedCost(s + 1)) {
-        continue;
-      }
-
-      IterateTrees(GetPlayerTrees(player, s) & ~GetDormant(),
-                   [&](u_int offset) {
-                     callback(Move::Grow(static_cast<uint8_t>(offset)), data);
-                   });
-    }
-  }
-
-  if (params.can_complete) {
-    /* Get complete moves */
-    if (sun >= 4) {
-      IterateTrees(
-          GetPlayerTrees(player, 3) & ~GetDormant(), [&](u_int offset) {
-            callback(Move::Complete(static_cast<uint8_t>(offset)), data);
-          });
-    }
-  }
-
-  if (params.can_seed) {
-    /* Get seed moves */
-    if (sun >= GetNumTrees(player, 0)) {
-      uint64_t block = GetAllTrees();
-
-      if (params.block_self_neighbor) {
-        IterateTrees(GetPlayerTrees(player),
-                     [&](u_int offset) { block |= SEED_BLOCK[offset]; });
-      }
-
-      for (u_int s = 1; s <= 3; ++s) {
-        if (params.block_self_neighbor && s == 1) {
-          continue;
-        }
-
-        IterateTrees(
-            GetPlayerTrees(player, s) & ~GetDormant(), [&](u_int target) {
-              uint64_t dest = SEED_DESTINATIONS[s - 1][target] & ~block & ~arid;
-              IterateTrees(dest, [&](u_int destination) {
-                callback(Move::Seed(static_cast<uint8_t>(target),
-                                    static_cast<uint8_t>(destination)),
-                         data);
-              });
-            });
-      }
-    }
-  }
+MoveSet GameState::GetMoveSet(u_int player, uint64_t const& arid,
+                              MoveFilterParams const params) const {
+  return DispatchMoveFilter(params, [&](auto filter) {
+    return GetMoveSet<decltype(filter)>(player, arid);
+  });
 }
 
 void GameState::Turn(u_int player, Move const& m, uint64_t const& arid) {
@@ -307,11 +241,16 @@ void GameState::Turn(u_int player, Move const& m, uint64_t const& arid) {
 
             /* Both seeded same place, remove seed and refund sun. */
             uint64_t t = GetTree(last_move.GetDestination());
+            if (dormant_ & t) {
+              hash_ ^= ZOBRIST.dormant[last_move.GetDestination()];
+            }
             trees_[0] &= ~t;
             dormant_ &= ~t;
             owner_[0] &= ~t;
-            dormant_ |= GetTree(m.GetTarget());
+            ToggleTree(last_move.GetDestination(), 0, 0);
+            SetDormant(GetTree(m.GetTarget()));
             AddSun(GetLastSeedCost(), 0);
+            ASSERT(hash_ == ComputeHash());
             return;
           }
           break;
@@ -384,6 +323,8 @@ void GameState::Turn(u_int player, Move const& m, uint64_t const& arid) {
                    nutrients + RICHNESS[m.GetTarget()]);
     } break;
   }
+
+  ASSERT(hash_ == ComputeHash());
 }
 
 void GameState::PlaceTree(u_int offset, u_int size, u_int player,
@@ -391,8 +332,10 @@ void GameState::PlaceTree(u_int offset, u_int size, u_int player,
   auto s = GetTree(offset);
   trees_[size] |= s;
   owner_[player] |= s;
+  ToggleTree(offset, player, size);
+  SetGrid(offset, player, size);
   if (dormant) {
-    dormant_ |= s;
+    SetDormant(s);
   }
 }
 
@@ -401,10 +344,9 @@ void GameState::GrowSeed(u_int source_offset, u_int dest_offset, u_int player,
   auto seed = GetTree(dest_offset);
   trees_[0] |= seed;
   owner_[player] |= seed;
-  dormant_ |= seed;
+  ToggleTree(dest_offset, player, 0);
 
-  auto source = GetTree(source_offset);
-  dormant_ |= source;
+  SetDormant(seed | GetTree(source_offset));
 
   RemoveSun(cost, player);
 }
@@ -414,6 +356,8 @@ void GameState::CompleteTree(u_int offset, u_int player, u_int cost,
   auto tree = GetTree(offset);
   trees_[3] &= ~tree;
   owner_[player] &= ~tree;
+  ToggleTree(offset, player, 3);
+  ClearGrid(offset, 3);
 
   RemoveSun(cost, player);
   AddScore(reward, player);
@@ -427,53 +371,156 @@ void GameState::EndDay() {
   ClearWaiting();
 
   if (GetDay() < 23) {
-    uint8_t direction = day % 6;
-    u_int sun_points[2]{};
-    uint64_t shadow_map = 0;
-
-    for (u_int s = 3; s > 0; s--) {
-      IterateTrees(GetTrees(s), [&](u_int offset) {
-        shadow_map |= SHADOW_TABLE[direction][s - 1][offset];
-      });
-
-      for (u_int player = 0u; player < 2; ++player) {
-        uint64_t valid_trees = GetPlayerTrees(player, s) & ~shadow_map;
-        sun_points[player] += util::popcnt(valid_trees) * s;
-      }
-    }
+    auto sun_points = GetSunIncome(GetSunDirection(day));
 
     for (u_int player = 0u; player < 2; ++player) {
       AddSun(sun_points[player], player);
     }
 
-    dormant_ = 0u;
+    ClearDormant();
   }
 
   SetDay(day);
+  ASSERT(hash_ == ComputeHash());
 }
 
-void GameState::Serialize(std::ostream& out) const {
-  for (auto const& t : trees_) {
-    out.write(reinterpret_cast<char const*>(&t), sizeof(t));
+u_int GameState::GetProjectedSun(u_int player, u_int n_days) const {
+  u_int day = GetDay();
+
+  /* Sun is only handed out when ending days 0 to 22. */
+  u_int n_ends = std::min(day + n_days, 23u);
+  n_ends = n_ends > day ? n_ends - day : 0u;
+
+  u_int total = 0u;
+  u_int cycle = 0u;
+  for (u_int i = 1; i <= std::min(n_ends, 6u); ++i) {
+    u_int income = GetSunIncome(GetSunDirection(day + i))[player];
+    cycle += income;
+    if (i <= n_ends % 6) {
+      total += income;
+    }
   }
-  for (auto const& o : owner_) {
-    out.write(reinterpret_cast<char const*>(&o), sizeof(o));
+
+  return total + (n_ends / 6) * cycle;
+}
+
+uint64_t GameState::ComputeHash() const {
+  uint64_t hash = 0u;
+
+  for (u_int p = 0u; p < 2; ++p) {
+    for (u_int s = 0u; s < 4; ++s) {
+      IterateTrees(GetPlayerTrees(p, s),
+                   [&](u_int offset) { hash ^= ZOBRIST.tree[p][s][offset]; });
+    }
+
+    if (IsWaiting(p)) {
+      hash ^= ZOBRIST.waiting[p];
+    }
+
+    hash ^= ZobristFieldKey(ZobristField::kScore, p, GetScore(p));
+    hash ^= ZobristFieldKey(ZobristField::kSun, p, GetSun(p));
   }
-  out.write(reinterpret_cast<char const*>(&dormant_), sizeof(dormant_));
+
+  IterateTrees(dormant_,
+               [&](u_int offset) { hash ^= ZOBRIST.dormant[offset]; });
+
+  hash ^= ZobristFieldKey(ZobristField::kDay, 0, GetDay());
+  hash ^= ZobristFieldKey(ZobristField::kNutrients, 0, GetNutrients());
+  hash ^= ZobristFieldKey(ZobristField::kOrientation, 0, GetOrientation());
+  hash ^= MoveKey(GetMove());
+
+  return hash;
 }
 
-GameState GameState::Deserialize(std::istream& in) {
-  GameState g;
+GameState GameState::Transform(u_int symmetry) const {
+  GameState g = *this;
 
   for (auto& t : g.trees_) {
-    in.read(reinterpret_cast<char*>(&t), sizeof(t));
+    t = (t & ~TREE_MASK) | TransformTrees(t, symmetry);
   }
   for (auto& o : g.owner_) {
-    in.read(reinterpret_cast<char*>(&o), sizeof(o));
+    o = (o & ~TREE_MASK) | TransformTrees(o, symmetry);
+  }
+  g.dormant_ = TransformTrees(dormant_, symmetry);
+  g.WriteMove(TransformMove(GetMove(), symmetry));
+  SetByte(SYMMETRY_COMPOSE[symmetry][GetOrientation()], 40u, g.trees_[1]);
+
+  g.hash_ = g.ComputeHash();
+  g.RefreshGrid();
+  return g;
+}
+
+Move GameState::TransformMove(Move const& m, u_int symmetry) {
+  if (!m.IsValid()) {
+    return m;
+  }
+
+  uint8_t target = SYMMETRY_CELLS[symmetry][m.GetTarget()];
+  switch (m.GetType()) {
+    case Move::Type::kGrow:
+      return Move::Grow(target);
+    case Move::Type::kComplete:
+      return Move::Complete(target);
+    case Move::Type::kSeed:
+      return Move::Seed(target, SYMMETRY_CELLS[symmetry][m.GetDestination()]);
+    default:
+      return m;
+  }
+}
+
+GameState GameState::Canonical(uint64_t& arid, u_int& symmetry) const {
+  GameState best = *this;
+  uint64_t best_arid = arid & TREE_MASK;
+  symmetry = 0u;
+
+  for (u_int s = 1u; s < N_SYMMETRIES; ++s) {
+    uint64_t a = TransformTrees(arid, s);
+    if (a > best_arid) {
+      continue;
+    }
+
+    GameState g = Transform(s);
+    if (a < best_arid || g.Hash() < best.Hash()) {
+      best = g;
+      best_arid = a;
+      symmetry = s;
+    }
   }
-  in.read(reinterpret_cast<char*>(&g.dormant_), sizeof(g.dormant_));
+
+  arid = best_arid;
+  return best;
+}
+
+std::array<uint64_t, GameState::kWords> GameState::ToWords() const {
+  return {trees_[0], trees_[1], trees_[2], trees_[3],
+          owner_[0], owner_[1], dormant_};
+}
+
+GameState GameState::FromWords(std::array<uint64_t, kWords> const& words) {
+  GameState g;
+
+  for (u_int s = 0u; s < 4; ++s) {
+    g.trees_[s] = words[s];
+  }
+  for (u_int p = 0u; p < 2; ++p) {
+    g.owner_[p] = words[4 + p];
+  }
+  g.dormant_ = words[6];
+  g.hash_ = g.ComputeHash();
+  g.RefreshGrid();
 
   return g;
 }
 
+void GameState::Serialize(std::ostream& out) const {
+  auto words = ToWords();
+  out.write(reinterpret_cast<char const*>(words.data()), sizeof(words));
+}
+
+GameState GameState::Deserialize(std::istream& in) {
+  std::array<uint64_t, kWords> words;
+  in.read(reinterpret_cast<char*>(words.data()), sizeof(words));
+  return FromWords(words);
+}
+
 }  // namespace engine
\ No newline at end of file
@@ -8,11 +8,17 @@
 #include <vector>
 
 #include "engine_Move.hpp"
+#include "engine_MoveList.hpp"
+#include "engine_MoveSet.hpp"
 #include "engine_Tables.hpp"
 #include "util_General.hpp"
 #include "util_TimeStamp.hpp"
 
 namespace engine {
+
+template <size_t kLanes>
+class GameStateBatch;
+
 class GameState {
  public:
   using TimeStamp = util::TimeStamp;
@@ -24,7 +30,12 @@ class GameState {
 
   static GameState RandomStart(uint64_t& arid);
 
-  GameState() { StoreMove(Move::Invalid()); }
+  /**
+   * Reproducible RandomStart, for benchmarks and tests.
+   */
+  static GameState RandomStart(uint64_t& arid, uint32_t seed);
+
+  GameState() { WriteMove(Move::Invalid()); }
 
   struct MoveFilterParams {
     bool block_self_neighbor;
@@ -37,10 +48,68 @@ class GameState {
     }
   };
 
-  std::vector<Move> GetMoves(
+  /**
+   * MoveFilterParams fixed at compile time, so generation for a given filter
+   * carries no flag checks.
+   */
+  template <bool kBlockSelfNeighbor = true, bool kCanSeed = true,
+            bool kCanGrow = true, bool kCanComplete = true>
+  struct MoveFilter {
+    static bool constexpr block_self_neighbor = kBlockSelfNeighbor;
+    static bool constexpr can_seed = kCanSeed;
+    static bool constexpr can_grow = kCanGrow;
+    static bool constexpr can_complete = kCanComplete;
+  };
+
+  /**
+   * Calls visitor with the MoveFilter matching params, turning runtime flags
+   * into a compile time one.
+   */
+  template <bool... kFlags, class Visitor>
+  static decltype(auto) DispatchMoveFilter(MoveFilterParams const& params,
+                                           Visitor&& visitor) {
+    size_t constexpr n_flags = sizeof...(kFlags);
+    if constexpr (n_flags == 4) {
+      return visitor(MoveFilter<kFlags...>{});
+    } else {
+      bool flag = n_flags == 0   ? params.block_self_neighbor
+                  : n_flags == 1 ? params.can_seed
+                  : n_flags == 2 ? params.can_grow
+                                 : params.can_complete;
+      if (flag) {
+        return DispatchMoveFilter<kFlags..., true>(params, visitor);
+      }
+      return DispatchMoveFilter<kFlags..., false>(params, visitor);
+    }
+  }
+
+  /**
+   * Legal moves as bitboards, for counting or sampling without listing them.
+   */
+  template <class Filter>
+  MoveSet GetMoveSet(u_int player, uint64_t const& arid) const;
+
+  MoveSet GetMoveSet(
+      u_int player, uint64_t const& arid,
+      MoveFilterParams const params = MoveFilterParams::Default()) const;
+
+  template <class Filter, class Callable>
+  void GetMoves(u_int player, Callable&& callable, uint64_t const& arid) const {
+    GetMoveSet<Filter>(player, arid).ForEach(callable);
+  }
+
+  template <class Filter>
+  MoveList GetMoves(u_int player, uint64_t const& arid) const {
+    MoveList moves;
+    GetMoves<Filter>(
+        player, [&](Move const& m) { moves.emplace_back(m); }, arid);
+    return moves;
+  }
+
+  MoveList GetMoves(
       u_int player, uint64_t const& arid,
       MoveFilterParams const params = MoveFilterParams::Default()) const {
-    std::vector<Move> moves;
+    MoveList moves;
     GetMoves(
         player, [&](Move const& m) { moves.emplace_back(m); }, arid, params);
     return moves;
@@ -50,14 +119,7 @@ class GameState {
   void GetMoves(
       u_int player, Callable&& callable, uint64_t const& arid,
       MoveFilterParams const params = MoveFilterParams::Default()) const {
-    auto local = std::move(callable);
-    GetMoves(
-        player,
-        [](Move const& m, void* data) {
-          Callable& p_callable = *static_cast<decltype(local)*>(data);
-          (p_callable)(m);
-        },
-        &local, arid, params);
+    GetMoveSet(player, arid, params).ForEach(callable);
   }
 
   void Turn(u_int player, Move const& m, uint64_t const& arid);
@@ -89,7 +151,27 @@ class GameState {
     return GetByte(48u + 8u * (player > 0 ? 1 : 0), trees_[2]);
   }
 
+  /**
+   * Zobrist key of everything operator== compares, kept up to date by every
+   * mutation.
+   */
+  uint64_t Hash() const { return hash_; }
+
+  uint64_t ComputeHash() const;
+
   bool operator==(GameState const& other) const {
+    if (GetDay() != other.GetDay()) {
+      return false;
+    }
+
+    if (GetOrientation() != other.GetOrientation()) {
+      return false;
+    }
+
+    if (Move::ToInt(GetMove()) != Move::ToInt(other.GetMove())) {
+      return false;
+    }
+
     for (size_t s = 0; s < 4; ++s) {
       if (GetTrees(s) != other.GetTrees(s)) {
         return false;
@@ -135,6 +217,52 @@ class GameState {
 
   uint64_t GetDormant() const { return dormant_; }
 
+  /**
+   * Symmetry (see N_SYMMETRIES) the board was transformed by relative to the
+   * sun, 0 unless the state came out of Transform.
+   */
+  u_int GetOrientation() const { return GetByte(40u, trees_[1]); }
+
+  /**
+   * Direction the sun shines towards on day.
+   */
+  u_int GetSunDirection(u_int day) const {
+    return SymmetryDirection(GetOrientation(), day % 6u);
+  }
+
+  /**
+   * The position with the board transformed by symmetry. It plays out like
+   * the original given the arid mask and moves transformed alike, see
+   * TransformTrees and TransformMove.
+   */
+  GameState Transform(u_int symmetry) const;
+
+  static Move TransformMove(Move const& m, u_int symmetry);
+
+  /**
+   * Representative shared by every symmetric copy of (position, arid). arid
+   * is replaced with its transformed mask and symmetry set to the
+   * transformation applied.
+   */
+  GameState Canonical(uint64_t& arid, u_int& symmetry) const;
+
+  /**
+   * Sun each player would collect at the end of a day with the sun shining
+   * towards direction, given the trees as they stand.
+   */
+  std::array<u_int, 2> GetSunIncome(u_int direction) const {
+    std::array<u_int, 2> income;
+    GridSunIncome(grid_[0], grid_[1], grid_[2], grid_owner_,
+                  (grid_[0] | grid_[1] | grid_[2]) & ~grid_owner_, direction,
+                  income[0], income[1]);
+    return income;
+  }
+
+  /**
+   * Sun the player collects over the next n_days day ends if no tree changes.
+   */
+  u_int GetProjectedSun(u_int player, u_int n_days) const;
+
   uint64_t GetOwner(u_int player) const { return owner_[player]; }
 
   uint64_t GetPlayerTrees(u_int player) const {
@@ -144,20 +272,82 @@ class GameState {
     return GetTrees(s) & owner_[player];
   }
 
+  /**
+   * The raw words Serialize writes, trees_ then owner_ then dormant_.
+   */
+  static size_t constexpr kWords = 7u;
+  std::array<uint64_t, kWords> ToWords() const;
+  static GameState FromWords(std::array<uint64_t, kWords> const& words);
+
   void Serialize(std::ostream& out) const;
 
   static GameState Deserialize(std::istream& in);
 
  private:
-  void GetMoves(u_int player, void (*callback)(Move const& m, void* data),
-                void* data, uint64_t const& arid,
-                MoveFilterParams const params) const;
+  template <size_t kLanes>
+  friend class GameStateBatch;
 
-  void SetWaiting(u_int player) { owner_[player] |= (1ull << 63); }
+  void SetWaiting(u_int player) {
+    if (!IsWaiting(player)) {
+      hash_ ^= ZOBRIST.waiting[player];
+    }
+    owner_[player] |= (1ull << 63);
+  }
 
   void ClearWaiting() {
-    owner_[0] &= ~(1ull << 63);
-    owner_[1] &= ~(1ull << 63);
+    for (u_int p = 0u; p < 2; ++p) {
+      if (IsWaiting(p)) {
+        hash_ ^= ZOBRIST.waiting[p];
+      }
+      owner_[p] &= ~(1ull << 63);
+    }
+  }
+
+  void SetDormant(uint64_t trees) {
+    IterateTrees(trees & ~dormant_,
+                 [&](u_int offset) { hash_ ^= ZOBRIST.dormant[offset]; });
+    dormant_ |= trees;
+  }
+
+  void ClearDormant() {
+    IterateTrees(dormant_,
+                 [&](u_int offset) { hash_ ^= ZOBRIST.dormant[offset]; });
+    dormant_ = 0u;
+  }
+
+  void ToggleTree(u_int offset, u_int player, u_int size) {
+    hash_ ^= ZOBRIST.tree[player][size][offset];
+  }
+
+  /**
+   * Grid layout mirror of the trees that cast shadows, kept in step with
+   * trees_ so EndDay only needs a few shifts.
+   */
+  void SetGrid(u_int offset, u_int player, u_int size) {
+    if (size == 0) {
+      return;
+    }
+    auto cell = GetTree(SPIRAL_TO_GRID[offset]);
+    grid_[size - 1] |= cell;
+    if (player == 0) {
+      grid_owner_ |= cell;
+    }
+  }
+
+  void ClearGrid(u_int offset, u_int size) {
+    if (size == 0) {
+      return;
+    }
+    auto cell = GetTree(SPIRAL_TO_GRID[offset]);
+    grid_[size - 1] &= ~cell;
+    grid_owner_ &= ~cell;
+  }
+
+  void RefreshGrid() {
+    for (u_int s = 1; s < 4; ++s) {
+      grid_[s - 1] = ToGrid(GetTrees(s));
+    }
+    grid_owner_ = ToGrid(GetPlayerTrees(0) & ~GetTrees(0));
   }
 
   void SetLastSeedCost(uint8_t seed_cost) {
@@ -176,7 +366,11 @@ class GameState {
     auto tree = GetTree(offset);
     trees_[size] &= ~tree;
     trees_[size + 1] |= tree;
-    dormant_ |= tree;
+    ToggleTree(offset, player, size);
+    ToggleTree(offset, player, size + 1);
+    ClearGrid(offset, size);
+    SetGrid(offset, player, size + 1);
+    SetDormant(tree);
 
     RemoveSun(cost, player);
   }
@@ -205,13 +399,22 @@ class GameState {
 
   void EndDay();
 
-  void SetDay(uint8_t day) { SetByte(day, 56u, trees_[0]); }
-  void SetNutrients(uint8_t nutrients) { SetByte(nutrients, 48u, trees_[0]); }
+  void SetDay(uint8_t day) {
+    SetHashedByte(day, 56u, trees_[0], ZobristField::kDay, 0);
+  }
+  void SetNutrients(uint8_t nutrients) {
+    SetHashedByte(nutrients, 48u, trees_[0], ZobristField::kNutrients, 0);
+  }
   void SetScore(uint8_t score, u_int player) {
-    SetByte(score, 48u + 8u * (player > 0 ? 1 : 0), trees_[1]);
+    SetHashedByte(score, 48u + 8u * (player > 0 ? 1 : 0), trees_[1],
+                  ZobristField::kScore, player);
+  }
+  void SetOrientation(uint8_t orientation) {
+    SetHashedByte(orientation, 40u, trees_[1], ZobristField::kOrientation, 0);
   }
   void SetSun(uint8_t sun, u_int player) {
-    SetByte(sun, 48u + 8u * (player > 0 ? 1 : 0), trees_[2]);
+    SetHashedByte(sun, 48u + 8u * (player > 0 ? 1 : 0), trees_[2],
+                  ZobristField::kSun, player);
   }
 
   void RemoveSun(u_int amount, u_int player) {
@@ -232,11 +435,29 @@ class GameState {
     return reinterpret_cast<uint8_t*>(&buffer)[offset / 8u];
   }
 
-  void StoreMove(Move const& m) {
+  void SetHashedByte(uint8_t byte, u_int offset, uint64_t& buffer,
+                     ZobristField field, u_int player) {
+    hash_ ^= ZobristFieldKey(field, player, GetByte(offset, buffer)) ^
+             ZobristFieldKey(field, player, byte);
+    SetByte(byte, offset, buffer);
+  }
+
+  static uint64_t MoveKey(Move const& m) {
+    return m.IsValid() ? ZobristFieldKey(ZobristField::kMove, 0,
+                                         Move::ToInt(m) + 1u)
+                       : 0u;
+  }
+
+  void WriteMove(Move const& m) {
     auto dest = reinterpret_cast<uint16_t*>(&trees_[3]) + 3;
     *dest = Move::ToInt(m);
   }
 
+  void StoreMove(Move const& m) {
+    hash_ ^= MoveKey(GetMove()) ^ MoveKey(m);
+    WriteMove(m);
+  }
+
   void ClearMove() { StoreMove(Move::Invalid()); }
 
   Move GetMove() const {
@@ -247,7 +468,64 @@ class GameState {
   std::array<uint64_t, 4> trees_{};
   std::array<uint64_t, 2> owner_{};
   uint64_t dormant_{};
+  uint64_t hash_{};
+  std::array<uint64_t, 3> grid_{};
+  uint64_t grid_owner_{};
 };
+
+template <class Filter>
+MoveSet GameState::GetMoveSet(u_int player, uint64_t const& arid) const {
+  MoveSet moves;
+  if (IsTerminal()) {
+    return moves;
+  }
+
+  /* Can always wait. */
+  moves.SetWait(true);
+
+  uint8_t sun = GetSun(player);
+
+  /* Get grow moves */
+  if constexpr (Filter::can_grow) {
+    for (u_int s = 0; s < 3; ++s) {
+      u_int n_trees = GetNumTrees(player, s + 1);
+      if (sun < n_trees + GetTreeFixedCost(s + 1)) {
+        continue;
+      }
+
+      moves.AddGrow(s, GetPlayerTrees(player, s) & ~GetDormant());
+    }
+  }
+
+  if constexpr (Filter::can_complete) {
+    /* Get complete moves */
+    if (sun >= 4) {
+      moves.SetComplete(GetPlayerTrees(player, 3) & ~GetDormant());
+    }
+  }
+
+  if constexpr (Filter::can_seed) {
+    /* Get seed moves */
+    if (sun >= GetNumTrees(player, 0)) {
+      uint64_t block = GetAllTrees() | arid;
+
+      if constexpr (Filter::block_self_neighbor) {
+        IterateTrees(GetPlayerTrees(player),
+                     [&](u_int offset) { block |= SEED_BLOCK[offset]; });
+      }
+
+      u_int constexpr min_size = Filter::block_self_neighbor ? 2 : 1;
+      for (u_int s = min_size; s <= 3; ++s) {
+        IterateTrees(
+            GetPlayerTrees(player, s) & ~GetDormant(), [&](u_int target) {
+              moves.AddSeeds(target, SEED_DESTINATIONS[s - 1][target] & ~block);
+            });
+      }
+    }
+  }
+
+  return moves;
+}
 }  // namespace engine
 
 #endif /* __INCLUDE_GUARD_ENGINE_GAMESTATE_HPP */
\ No newline at end of file
@@ -0,0 +1,394 @@
+#ifndef __INCLUDE_GUARD_ENGINE_GAMESTATEBATCH_HPP
+#define __INCLUDE_GUARD_ENGINE_GAMESTATEBATCH_HPP
+
+#include <array>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "engine_GameState.hpp"
+#include "engine_Move.hpp"
+#include "engine_Tables.hpp"
+#include "util_General.hpp"
+
+namespace engine {
+
+/**
+ * Structure-of-arrays copy of kLanes games that all started from the same
+ * position, used to score a leaf with several rollouts at once.
+ *
+ * Bitboards are stored in the grid layout (see SPIRAL_TO_GRID) so shadows are
+ * shifts. Every lane shares the same day: lanes play their own turns until
+ * both players wait, then EndDay advances all lanes with one vector kernel.
+ */
+template <size_t kLanes>
+class GameStateBatch {
+ public:
+  static_assert(kLanes >= 4 && kLanes <= 16 && kLanes % 4 == 0,
+                "Lanes must fill whole 256 bit vectors.");
+
+  GameStateBatch(GameState const& g, uint64_t const& arid)
+      : arid_(ToGrid(arid)),
+        day_(g.GetDay()),
+        orientation_(static_cast<uint8_t>(g.GetOrientation())) {
+    for (size_t l = 0; l < kLanes; ++l) {
+      for (u_int s = 0; s < 4; ++s) {
+        trees_[s][l] = ToGrid(g.GetTrees(s));
+      }
+      for (u_int p = 0; p < 2; ++p) {
+        owner_[p][l] = ToGrid(g.GetOwner(p) & TREE_MASK);
+        sun_[p][l] = g.GetSun(p);
+        score_[p][l] = g.GetScore(p);
+      }
+      dormant_[l] = ToGrid(g.GetDormant());
+      nutrients_[l] = g.GetNutrients();
+      last_nutrients_[l] = g.GetLastNutrients();
+      last_seed_cost_[l] = g.GetLastSeedCost();
+      waiting_[l] = (g.IsWaiting(0) ? 1u : 0u) | (g.IsWaiting(1) ? 2u : 0u);
+      move_[l] = g.GetMove();
+    }
+  }
+
+  GameState Get(size_t lane) const {
+    GameState g;
+    for (u_int s = 0; s < 4; ++s) {
+      g.trees_[s] |= FromGrid(trees_[s][lane]);
+    }
+    for (u_int p = 0; p < 2; ++p) {
+      g.owner_[p] |= FromGrid(owner_[p][lane]);
+      g.SetSun(sun_[p][lane], p);
+      g.SetScore(score_[p][lane], p);
+      if (waiting_[lane] & (1u << p)) {
+        g.SetWaiting(p);
+      }
+    }
+    g.dormant_ = FromGrid(dormant_[lane]);
+    g.SetDay(day_);
+    g.SetOrientation(orientation_);
+    g.SetNutrients(nutrients_[lane]);
+    g.SetLastNutrients(last_nutrients_[lane]);
+    g.SetLastSeedCost(last_seed_cost_[lane]);
+    g.StoreMove(move_[lane]);
+    g.hash_ = g.ComputeHash();
+    g.RefreshGrid();
+    return g;
+  }
+
+  bool IsTerminal() const { return day_ == 24; }
+  uint8_t GetDay() const { return day_; }
+  uint8_t GetScore(size_t lane, u_int player) const {
+    return score_[player][lane];
+  }
+  uint8_t GetSun(size_t lane, u_int player) const {
+    return sun_[player][lane];
+  }
+
+  /**
+   * Play every lane to the end of the game with the rollout policy.
+   */
+  template <class Rand>
+  void Rollout(Rand&& rand_func) {
+    while (!IsTerminal()) {
+      for (size_t l = 0; l < kLanes; ++l) {
+        while (waiting_[l] != 3u) {
+          u_int player = NextPlayer(l);
+          Turn(l, player, SampleRolloutMove(l, player, rand_func));
+        }
+      }
+      EndDay();
+    }
+  }
+
+  u_int NextPlayer(size_t lane) const {
+    if (waiting_[lane] & 1u) {
+      return 1;
+    }
+
+    if (waiting_[lane] & 2u) {
+      return 0;
+    }
+
+    return move_[lane].IsValid() ? 1u : 0u;
+  }
+
+  /**
+   * Uniform pick from the moves Mcts::GetRolloutMoves would list, counted
+   * straight from the bitboards.
+   */
+  template <class Rand>
+  Move SampleRolloutMove(size_t lane, u_int player, Rand&& rand_func) const {
+    uint64_t own = owner_[player][lane];
+    uint64_t active = own & ~dormant_[lane];
+    uint8_t sun = sun_[player][lane];
+
+    bool can_complete = day_ >= 11 && sun >= 4 &&
+                        (day_ >= 22 || util::popcnt(trees_[3][lane] & own) >= 4);
+    if (can_complete) {
+      uint64_t complete = trees_[3][lane] & active;
+      u_int n = util::popcnt(complete);
+      if (n > 0) {
+        u_int pick = rand_func() % (n + 1);
+        return pick == n ? Move::Wait() : Move::Complete(NthTree(complete, pick));
+      }
+    }
+
+    if (day_ <= 19) {
+      uint64_t grow = 0u;
+      for (u_int s = 0; s < 3; ++s) {
+        u_int cost = util::popcnt(trees_[s + 1][lane] & own) + (2u << s) - 1u;
+        if (sun >= cost) {
+          grow |= trees_[s][lane] & active;
+        }
+      }
+      u_int n = util::popcnt(grow);
+      if (n > 0) {
+        u_int pick = rand_func() % (n + 1);
+        return pick == n ? Move::Wait() : Move::Grow(NthTree(grow, pick));
+      }
+    }
+
+    if (trees_[0][lane] & own) {
+      return Move::Wait();
+    }
+
+    uint64_t block = arid_;
+    for (u_int s = 0; s < 4; ++s) {
+      block |= trees_[s][lane];
+    }
+    IterateTrees(own, [&](u_int offset) {
+      block |= GRID_SEED_BLOCK[GRID_TO_SPIRAL[offset]];
+    });
+
+    std::array<uint64_t, N_TREES> destinations;
+    std::array<uint8_t, N_TREES> sources;
+    u_int n_sources = 0;
+    u_int n = 0;
+    for (u_int s = 2; s <= 3; ++s) {
+      IterateTrees(trees_[s][lane] & active, [&](u_int offset) {
+        uint8_t source = GRID_TO_SPIRAL[offset];
+        uint64_t dest = GRID_SEED_DESTINATIONS[s - 1][source] & ~block;
+        if (dest) {
+          destinations[n_sources] = dest;
+          sources[n_sources++] = source;
+          n += util::popcnt(dest);
+        }
+      });
+    }
+
+    u_int pick = rand_func() % (n + 1);
+    if (pick == n) {
+      return Move::Wait();
+    }
+
+    for (u_int i = 0;; ++i) {
+      u_int count = util::popcnt(destinations[i]);
+      if (pick < count) {
+        return Move::Seed(sources[i], NthTree(destinations[i], pick));
+      }
+      pick -= count;
+    }
+  }
+
+  /**
+   * Lane copy of GameState::Turn, except that the day is not ended when both
+   * players wait: that is left to EndDay so all lanes roll over together.
+   */
+  void Turn(size_t lane, u_int player, Move const& m) {
+    ASSERT(player == NextPlayer(lane));
+
+    auto last_move = move_[lane];
+    if (last_move.IsValid()) {
+      move_[lane] = Move::Invalid();
+
+      if (m.GetType() == Move::Type::kSeed &&
+          last_move.GetType() == Move::Type::kSeed &&
+          last_move.GetDestination() == m.GetDestination()) {
+        /* Both seeded same place, remove seed and refund sun. */
+        uint64_t t = Cell(m.GetDestination());
+        trees_[0][lane] &= ~t;
+        dormant_[lane] &= ~t;
+        owner_[0][lane] &= ~t;
+        dormant_[lane] |= Cell(m.GetTarget());
+        sun_[0][lane] += last_seed_cost_[lane];
+        return;
+      }
+    } else if (!(waiting_[lane] & 2u) && player == 0u) {
+      move_[lane] = m;
+      last_nutrients_[lane] = nutrients_[lane];
+    }
+
+    switch (m.GetType()) {
+      case Move::Type::kWait:
+        waiting_[lane] |= 1u << player;
+        break;
+      case Move::Type::kSeed: {
+        uint8_t cost = util::popcnt(trees_[0][lane] & owner_[player][lane]);
+        uint64_t seed = Cell(m.GetDestination());
+        trees_[0][lane] |= seed;
+        owner_[player][lane] |= seed;
+        dormant_[lane] |= seed | Cell(m.GetTarget());
+        sun_[player][lane] -= cost;
+        if (!last_move.IsValid()) {
+          last_seed_cost_[lane] = cost;
+        }
+      } break;
+      case Move::Type::kGrow: {
+        uint64_t tree = Cell(m.GetTarget());
+        u_int s = 0;
+        while (!(trees_[s][lane] & tree)) {
+          ++s;
+        }
+        uint8_t cost = util::popcnt(trees_[s + 1][lane] & owner_[player][lane]) +
+                       (2u << s) - 1u;
+        trees_[s][lane] &= ~tree;
+        trees_[s + 1][lane] |= tree;
+        dormant_[lane] |= tree;
+        sun_[player][lane] -= cost;
+      } break;
+      case Move::Type::kComplete: {
+        uint64_t tree = Cell(m.GetTarget());
+        uint8_t nutrients =
+            last_move.IsValid() ? last_nutrients_[lane] : nutrients_[lane];
+        trees_[3][lane] &= ~tree;
+        owner_[player][lane] &= ~tree;
+        sun_[player][lane] -= 4u;
+        score_[player][lane] += nutrients + RICHNESS[m.GetTarget()];
+        if (nutrients_[lane] > 0) {
+          nutrients_[lane]--;
+        }
+      } break;
+    }
+  }
+
+  /**
+   * Advance every lane to the next day, collecting sun for the new sun
+   * direction.
+   */
+  void EndDay() {
+    if (day_ < 23) {
+      u_int direction = SymmetryDirection(orientation_, (day_ + 1u) % 6u);
+      alignas(32) std::array<uint64_t, kLanes> income[2];
+
+#ifdef __AVX2__
+      for (size_t l = 0; l < kLanes; l += 4) {
+        SunKernel(direction, l, income[0].data() + l, income[1].data() + l);
+      }
+#else
+      for (size_t l = 0; l < kLanes; ++l) {
+        SunScalar(direction, l, income[0][l], income[1][l]);
+      }
+#endif
+
+      for (u_int p = 0; p < 2; ++p) {
+        for (size_t l = 0; l < kLanes; ++l) {
+          sun_[p][l] += static_cast<uint8_t>(income[p][l]);
+        }
+      }
+
+      dormant_.fill(0u);
+    }
+
+    waiting_.fill(0u);
+    day_++;
+  }
+
+ private:
+  static uint64_t Cell(u_int offset) { return GetTree(SPIRAL_TO_GRID[offset]); }
+
+  /**
+   * Spiral offset of the n'th set bit of a grid mask.
+   */
+  static uint8_t NthTree(uint64_t grid, u_int n) {
+    return GRID_TO_SPIRAL[util::SelectBit(grid, n)];
+  }
+
+  void SunScalar(u_int direction, size_t l, uint64_t& p0, uint64_t& p1) const {
+    u_int sun[2];
+    GridSunIncome(trees_[1][l], trees_[2][l], trees_[3][l], owner_[0][l],
+                  owner_[1][l], direction, sun[0], sun[1]);
+    p0 = sun[0];
+    p1 = sun[1];
+  }
+
+#ifdef __AVX2__
+  /**
+   * GridSunIncome for 4 lanes, with a nibble lookup popcount.
+   */
+  void SunKernel(u_int direction, size_t l, uint64_t* p0, uint64_t* p1) const {
+    int8_t step = GRID_STEP[direction];
+    __m128i count = _mm_cvtsi32_si128(step > 0 ? step : -step);
+    __m256i mask = _mm256_set1_epi64x(static_cast<long long>(GRID_MASK));
+    auto shift = [&](__m256i v) {
+      v = step > 0 ? _mm256_sll_epi64(v, count) : _mm256_srl_epi64(v, count);
+      return _mm256_and_si256(v, mask);
+    };
+    auto load = [&](std::array<uint64_t, kLanes> const& a) {
+      return _mm256_load_si256(reinterpret_cast<__m256i const*>(&a[l]));
+    };
+
+    __m256i t1 = load(trees_[1]);
+    __m256i t2 = load(trees_[2]);
+    __m256i t3 = load(trees_[3]);
+
+    __m256i a1 = shift(t3);
+    __m256i a2 = shift(a1);
+    __m256i shade3 = _mm256_or_si256(_mm256_or_si256(a1, a2), shift(a2));
+    __m256i b1 = shift(t2);
+    __m256i shade2 =
+        _mm256_or_si256(shade3, _mm256_or_si256(b1, shift(b1)));
+    __m256i shade1 = _mm256_or_si256(shade2, shift(t1));
+
+    __m256i lit1 = _mm256_andnot_si256(shade1, t1);
+    __m256i lit2 = _mm256_andnot_si256(shade2, t2);
+    __m256i lit3 = _mm256_andnot_si256(shade3, t3);
+
+    __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3,
+                                   4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3,
+                                   3, 4);
+    __m256i low = _mm256_set1_epi8(0x0F);
+    auto bytes = [&](__m256i v) {
+      __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+      __m256i hi = _mm256_shuffle_epi8(
+          lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+      return _mm256_add_epi8(lo, hi);
+    };
+
+    /* Weighted per byte count, at most 8 * (1 + 2 + 3) so it fits a byte. */
+    auto income = [&](__m256i owner) {
+      __m256i c1 = bytes(_mm256_and_si256(lit1, owner));
+      __m256i c2 = bytes(_mm256_and_si256(lit2, owner));
+      __m256i c3 = bytes(_mm256_and_si256(lit3, owner));
+      __m256i sum = _mm256_add_epi8(
+          c1, _mm256_add_epi8(_mm256_add_epi8(c2, c2),
+                              _mm256_add_epi8(c3, _mm256_add_epi8(c3, c3))));
+      return _mm256_sad_epu8(sum, _mm256_setzero_si256());
+    };
+
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p0), income(load(owner_[0])));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p1), income(load(owner_[1])));
+  }
+#endif
+
+  using Lanes = std::array<uint64_t, kLanes>;
+  using ByteLanes = std::array<uint8_t, kLanes>;
+
+  alignas(32) std::array<Lanes, 4> trees_;
+  alignas(32) std::array<Lanes, 2> owner_;
+  alignas(32) Lanes dormant_;
+  std::array<ByteLanes, 2> sun_;
+  std::array<ByteLanes, 2> score_;
+  ByteLanes nutrients_;
+  ByteLanes last_nutrients_;
+  ByteLanes last_seed_cost_;
+  ByteLanes waiting_;
+  std::array<Move, kLanes> move_;
+  uint64_t arid_;
+  uint8_t day_;
+  uint8_t orientation_;
+};
+
+}  // namespace engine
+
+#endif /* __INCLUDE_GUARD_ENGINE_GAMESTATEBATCH_HPP */
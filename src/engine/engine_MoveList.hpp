@@ -0,0 +1,73 @@
+#ifndef __INCLUDE_GUARD_ENGINE_MOVELIST_HPP
+#define __INCLUDE_GUARD_ENGINE_MOVELIST_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include "engine_Move.hpp"
+#include "engine_Tables.hpp"
+#include "util_General.hpp"
+
+namespace engine {
+
+inline auto constexpr MakeNeighborSeedMoves() {
+  uint64_t n_moves = 0;
+
+  for (u_int t = 0; t < N_TREES; ++t) {
+    for (u_int d = 0; d < N_TREES; ++d) {
+      if (GetTree(d) & SEED_DESTINATIONS[0][t]) {
+        n_moves++;
+      }
+    }
+  }
+
+  return n_moves;
+}
+
+/**
+ * Stack resident list of moves with room for any position: one wait, one
+ * grow or complete per tree, and every (source, destination) seed pair.
+ */
+class MoveList {
+ public:
+  static size_t constexpr kCapacity =
+      1u + N_TREES + SEED_MOVES + MakeNeighborSeedMoves();
+
+  /* Storage is deliberately left uninitialized. */
+  MoveList() {}
+
+  void push_back(Move const& m) {
+    ASSERT(size_ < kCapacity);
+    moves_[size_++] = m;
+  }
+  void emplace_back(Move const& m) { push_back(m); }
+
+  void clear() { size_ = 0; }
+
+  Move* erase(Move* first, Move* last) {
+    Move* new_end = std::copy(last, end(), first);
+    size_ = static_cast<uint16_t>(new_end - begin());
+    return first;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Move& operator[](size_t i) { return moves_[i]; }
+  Move const& operator[](size_t i) const { return moves_[i]; }
+
+  Move* begin() { return moves_; }
+  Move* end() { return moves_ + size_; }
+  Move const* begin() const { return moves_; }
+  Move const* end() const { return moves_ + size_; }
+
+ private:
+  uint16_t size_{0};
+  union {
+    Move moves_[kCapacity];
+  };
+};
+
+}  // namespace engine
+
+#endif /* __INCLUDE_GUARD_ENGINE_MOVELIST_HPP */
@@ -0,0 +1,174 @@
+#ifndef __INCLUDE_GUARD_ENGINE_MOVESET_HPP
+#define __INCLUDE_GUARD_ENGINE_MOVESET_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "engine_Move.hpp"
+#include "engine_Tables.hpp"
+#include "util_General.hpp"
+
+namespace engine {
+
+/**
+ * The moves of a position kept as bitboards: one mask of growable trees per
+ * size, one of completable trees and a destination mask per seed source.
+ * Counting is a few popcnts and sampling never materializes the moves.
+ */
+class MoveSet {
+ public:
+  /* Seed destinations are only valid for sources in seed_sources_. */
+  MoveSet() {}
+
+  void SetWait(bool can_wait) { wait_ = can_wait; }
+  void AddGrow(u_int size, uint64_t trees) { grow_[size] |= trees; }
+  void SetComplete(uint64_t trees) { complete_ = trees; }
+  void AddSeeds(u_int source, uint64_t destinations) {
+    if (destinations == 0u) {
+      return;
+    }
+    seeds_[source] = destinations;
+    seed_sources_ |= GetTree(source);
+    n_seeds_ += util::popcnt(destinations);
+  }
+
+  u_int Count(Move::Type type) const {
+    switch (type) {
+      case Move::Type::kWait:
+        return wait_ ? 1u : 0u;
+      case Move::Type::kGrow:
+        return util::popcnt(grow_[0] | grow_[1] | grow_[2]);
+      case Move::Type::kComplete:
+        return util::popcnt(complete_);
+      case Move::Type::kSeed:
+        return n_seeds_;
+    }
+    return 0u;
+  }
+
+  u_int Count() const {
+    return Count(Move::Type::kWait) + Count(Move::Type::kGrow) +
+           Count(Move::Type::kComplete) + n_seeds_;
+  }
+
+  bool empty() const { return Count() == 0u; }
+
+  void Clear(Move::Type type) {
+    switch (type) {
+      case Move::Type::kWait:
+        wait_ = false;
+        break;
+      case Move::Type::kGrow:
+        grow_.fill(0u);
+        break;
+      case Move::Type::kComplete:
+        complete_ = 0u;
+        break;
+      case Move::Type::kSeed:
+        seed_sources_ = 0u;
+        n_seeds_ = 0u;
+        break;
+    }
+  }
+
+  /**
+   * Rollout priority: completing beats growing, and either beats seeding.
+   */
+  void KeepPreferred() {
+    if (complete_) {
+      Clear(Move::Type::kGrow);
+    }
+    if (n_seeds_ > 0 && (complete_ || grow_[0] | grow_[1] | grow_[2])) {
+      Clear(Move::Type::kSeed);
+    }
+  }
+
+  /**
+   * The n-th move in ForEach order, n must be below Count().
+   */
+  Move Get(u_int n) const {
+    ASSERT(n < Count());
+
+    if (wait_) {
+      if (n == 0u) {
+        return Move::Wait();
+      }
+      n--;
+    }
+
+    for (u_int s = 0; s < 3; ++s) {
+      u_int count = util::popcnt(grow_[s]);
+      if (n < count) {
+        return Move::Grow(static_cast<uint8_t>(util::SelectBit(grow_[s], n)));
+      }
+      n -= count;
+    }
+
+    u_int count = util::popcnt(complete_);
+    if (n < count) {
+      return Move::Complete(
+          static_cast<uint8_t>(util::SelectBit(complete_, n)));
+    }
+    n -= count;
+
+    uint64_t sources = seed_sources_;
+    while (true) {
+      u_int source = __builtin_ctzll(sources);
+      uint64_t destinations = seeds_[source];
+      count = util::popcnt(destinations);
+      if (n < count) {
+        return Move::Seed(
+            static_cast<uint8_t>(source),
+            static_cast<uint8_t>(util::SelectBit(destinations, n)));
+      }
+      n -= count;
+      sources &= sources - 1u;
+    }
+  }
+
+  /**
+   * Uniform pick, rand_func returns a non negative integer.
+   */
+  template <class Rand>
+  Move Sample(Rand&& rand_func) const {
+    return Get(static_cast<u_int>(rand_func()) % Count());
+  }
+
+  template <class Callable>
+  void ForEach(Callable&& callable) const {
+    if (wait_) {
+      callable(Move::Wait());
+    }
+
+    for (u_int s = 0; s < 3; ++s) {
+      IterateTrees(grow_[s], [&](u_int offset) {
+        callable(Move::Grow(static_cast<uint8_t>(offset)));
+      });
+    }
+
+    IterateTrees(complete_, [&](u_int offset) {
+      callable(Move::Complete(static_cast<uint8_t>(offset)));
+    });
+
+    IterateTrees(seed_sources_, [&](u_int source) {
+      IterateTrees(seeds_[source], [&](u_int destination) {
+        callable(Move::Seed(static_cast<uint8_t>(source),
+                            static_cast<uint8_t>(destination)));
+      });
+    });
+  }
+
+ private:
+  bool wait_{false};
+  u_int n_seeds_{0u};
+  std::array<uint64_t, 3> grow_{};
+  uint64_t complete_{0u};
+  uint64_t seed_sources_{0u};
+  union {
+    std::array<uint64_t, N_TREES> seeds_;
+  };
+};
+
+}  // namespace engine
+
+#endif /* __INCLUDE_GUARD_ENGINE_MOVESET_HPP */
@@ -193,9 +193,7 @@ class Referee {
       });
     }
 
-    auto params = GameState::MoveFilterParams::Default();
-    params.block_self_neighbor = false;
-    auto moves = g.GetMoves(player, arid, params);
+    auto moves = g.GetMoves<GameState::MoveFilter<false>>(player, arid);
     turn_input << moves.size() << "\n";
     for (auto const& m : moves) {
       turn_input << m << "\n";
@@ -151,6 +151,390 @@ inline auto constexpr MakeSeedMoves() {
 
 static auto constexpr SEED_MOVES = MakeSeedMoves();
 
+/**
+ * Axial (q, r) step for each of the 6 directions used by NEIGHBOR_TABLE.
+ */
+static int8_t constexpr DIRECTION_Q[6] = {1, 1, 0, -1, -1, 0};
+static int8_t constexpr DIRECTION_R[6] = {0, -1, -1, 0, 1, 1};
+
+/**
+ * Grid layout: the board embedded in a 7x8 bit grid (one guard column per
+ * row), so a step in any direction is a plain shift followed by a mask.
+ */
+static u_int constexpr GRID_ROW = 8u;
+static u_int constexpr GRID_RADIUS = 3u;
+
+inline auto constexpr MakeSpiralToGrid() {
+  std::array<int8_t, N_TREES> q{};
+  std::array<int8_t, N_TREES> r{};
+  std::array<bool, N_TREES> known{};
+  known[0] = true;
+
+  /* Walk outwards from the center, placing each neighbor relative to a known
+   * cell. */
+  for (u_int pass = 0u; pass < N_TREES; ++pass) {
+    for (u_int o = 0u; o < N_TREES; ++o) {
+      if (!known[o]) {
+        continue;
+      }
+      for (u_int d = 0u; d < 6u; ++d) {
+        int8_t n = NEIGHBOR_TABLE[o][d];
+        if (n != -1 && !known[n]) {
+          q[n] = q[o] + DIRECTION_Q[d];
+          r[n] = r[o] + DIRECTION_R[d];
+          known[n] = true;
+        }
+      }
+    }
+  }
+
+  std::array<uint8_t, N_TREES> table{};
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    table[o] = static_cast<uint8_t>((r[o] + GRID_RADIUS) * GRID_ROW +
+                                    (q[o] + GRID_RADIUS));
+  }
+
+  return table;
+}
+
+static auto constexpr SPIRAL_TO_GRID = MakeSpiralToGrid();
+
+inline auto constexpr MakeGridToSpiral() {
+  std::array<uint8_t, 64> table{};
+
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    table[SPIRAL_TO_GRID[o]] = static_cast<uint8_t>(o);
+  }
+
+  return table;
+}
+
+static auto constexpr GRID_TO_SPIRAL = MakeGridToSpiral();
+
+inline uint64_t constexpr ToGrid(uint64_t trees) {
+  uint64_t grid = 0u;
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    if (trees & GetTree(o)) {
+      grid |= GetTree(SPIRAL_TO_GRID[o]);
+    }
+  }
+  return grid;
+}
+
+inline uint64_t constexpr FromGrid(uint64_t grid) {
+  uint64_t trees = 0u;
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    if (grid & GetTree(SPIRAL_TO_GRID[o])) {
+      trees |= GetTree(o);
+    }
+  }
+  return trees;
+}
+
+static uint64_t constexpr GRID_MASK = ToGrid(TREE_MASK);
+
+/**
+ * Bit offset of a single step in each direction within the grid layout.
+ */
+inline auto constexpr MakeGridStep() {
+  std::array<int8_t, 6> table{};
+
+  for (u_int d = 0u; d < 6u; ++d) {
+    table[d] = static_cast<int8_t>(DIRECTION_Q[d] + DIRECTION_R[d] * GRID_ROW);
+  }
+
+  return table;
+}
+
+static auto constexpr GRID_STEP = MakeGridStep();
+
+inline uint64_t constexpr GridShift(uint64_t grid, u_int direction) {
+  int8_t step = GRID_STEP[direction];
+  grid = step > 0 ? (grid << step) : (grid >> -step);
+  return grid & GRID_MASK;
+}
+
+inline bool constexpr CheckGridLayout() {
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    for (u_int d = 0u; d < 6u; ++d) {
+      int8_t n = NEIGHBOR_TABLE[o][d];
+      uint64_t expected = n == -1 ? 0u : GetTree(SPIRAL_TO_GRID[n]);
+      if (GridShift(GetTree(SPIRAL_TO_GRID[o]), d) != expected) {
+        return false;
+      }
+
+      uint64_t cursor = GetTree(SPIRAL_TO_GRID[o]);
+      uint64_t shadow = 0u;
+      for (u_int t = 0u; t < 3u; ++t) {
+        cursor = GridShift(cursor, d);
+        shadow |= cursor;
+        if (shadow != ToGrid(SHADOW_TABLE[d][t][o])) {
+          return false;
+        }
+      }
+    }
+  }
+  return FromGrid(GRID_MASK) == TREE_MASK;
+}
+
+static_assert(CheckGridLayout(), "Grid layout disagrees with NEIGHBOR_TABLE");
+
+/**
+ * Sun collected by each player with the sun shining towards direction, from
+ * grid layout masks of the size 1, 2 and 3 trees and of each player's trees.
+ */
+inline void constexpr GridSunIncome(uint64_t t1, uint64_t t2, uint64_t t3,
+                                    uint64_t owner0, uint64_t owner1,
+                                    u_int direction, u_int& p0, u_int& p1) {
+  /* A tree of size s is only shaded by trees at least as tall. */
+  uint64_t a1 = GridShift(t3, direction);
+  uint64_t a2 = GridShift(a1, direction);
+  uint64_t shade3 = a1 | a2 | GridShift(a2, direction);
+  uint64_t b1 = GridShift(t2, direction);
+  uint64_t shade2 = shade3 | b1 | GridShift(b1, direction);
+  uint64_t shade1 = shade2 | GridShift(t1, direction);
+
+  uint64_t lit1 = t1 & ~shade1;
+  uint64_t lit2 = t2 & ~shade2;
+  uint64_t lit3 = t3 & ~shade3;
+
+  auto income = [&](uint64_t owner) -> u_int {
+    return __builtin_popcountll(lit1 & owner) +
+           2u * __builtin_popcountll(lit2 & owner) +
+           3u * __builtin_popcountll(lit3 & owner);
+  };
+
+  p0 = income(owner0);
+  p1 = income(owner1);
+}
+
+inline auto constexpr MakeGridSeedDestinations() {
+  std::array<std::array<uint64_t, N_TREES>, 3> table{};
+
+  for (u_int s = 0u; s < 3u; ++s) {
+    for (u_int o = 0u; o < N_TREES; ++o) {
+      table[s][o] = ToGrid(SEED_DESTINATIONS[s][o]);
+    }
+  }
+
+  return table;
+}
+
+static auto constexpr GRID_SEED_DESTINATIONS = MakeGridSeedDestinations();
+
+inline auto constexpr MakeGridSeedBlock() {
+  std::array<uint64_t, N_TREES> table{};
+
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    table[o] = ToGrid(SEED_BLOCK[o]);
+  }
+
+  return table;
+}
+
+static auto constexpr GRID_SEED_BLOCK = MakeGridSeedBlock();
+
+/**
+ * The 12 symmetries of the board: symmetry % 6 rotations by one direction
+ * step, preceded by a mirror through direction 0 when symmetry >= 6. The sun
+ * direction has to be transformed together with the board.
+ */
+static u_int constexpr N_SYMMETRIES = 12u;
+
+inline u_int constexpr SymmetryDirection(u_int symmetry, u_int direction) {
+  u_int d = symmetry >= 6u ? (6u - direction) % 6u : direction;
+  return (d + symmetry) % 6u;
+}
+
+inline auto constexpr MakeSymmetryCells() {
+  std::array<std::array<uint8_t, N_TREES>, N_SYMMETRIES> table{};
+
+  for (u_int s = 0u; s < N_SYMMETRIES; ++s) {
+    for (u_int o = 0u; o < N_TREES; ++o) {
+      int q = static_cast<int>(SPIRAL_TO_GRID[o] % GRID_ROW) - GRID_RADIUS;
+      int r = static_cast<int>(SPIRAL_TO_GRID[o] / GRID_ROW) - GRID_RADIUS;
+      if (s >= 6u) {
+        q = q + r;
+        r = -r;
+      }
+      for (u_int k = 0u; k < s % 6u; ++k) {
+        int rotated_q = q + r;
+        r = -q;
+        q = rotated_q;
+      }
+      table[s][o] =
+          GRID_TO_SPIRAL[(r + GRID_RADIUS) * GRID_ROW + (q + GRID_RADIUS)];
+    }
+  }
+
+  return table;
+}
+
+static auto constexpr SYMMETRY_CELLS = MakeSymmetryCells();
+
+inline uint64_t constexpr TransformTrees(uint64_t trees, u_int symmetry) {
+  uint64_t result = 0u;
+  trees &= TREE_MASK;
+  while (trees != 0u) {
+    result |= GetTree(SYMMETRY_CELLS[symmetry][__builtin_ctzll(trees)]);
+    trees &= trees - 1u;
+  }
+  return result;
+}
+
+/**
+ * SYMMETRY_COMPOSE[a][b] applies b, then a.
+ */
+inline auto constexpr MakeSymmetryCompose() {
+  std::array<std::array<uint8_t, N_SYMMETRIES>, N_SYMMETRIES> table{};
+
+  for (u_int a = 0u; a < N_SYMMETRIES; ++a) {
+    for (u_int b = 0u; b < N_SYMMETRIES; ++b) {
+      for (u_int c = 0u; c < N_SYMMETRIES; ++c) {
+        bool match = true;
+        for (u_int d = 0u; d < 6u; ++d) {
+          match = match && SymmetryDirection(c, d) ==
+                               SymmetryDirection(a, SymmetryDirection(b, d));
+        }
+        if (match) {
+          table[a][b] = static_cast<uint8_t>(c);
+        }
+      }
+    }
+  }
+
+  return table;
+}
+
+static auto constexpr SYMMETRY_COMPOSE = MakeSymmetryCompose();
+
+inline auto constexpr MakeSymmetryInverse() {
+  std::array<uint8_t, N_SYMMETRIES> table{};
+
+  for (u_int s = 0u; s < N_SYMMETRIES; ++s) {
+    for (u_int i = 0u; i < N_SYMMETRIES; ++i) {
+      if (SYMMETRY_COMPOSE[i][s] == 0u) {
+        table[s] = static_cast<uint8_t>(i);
+      }
+    }
+  }
+
+  return table;
+}
+
+static auto constexpr SYMMETRY_INVERSE = MakeSymmetryInverse();
+
+inline bool constexpr CheckSymmetries() {
+  for (u_int s = 0u; s < N_SYMMETRIES; ++s) {
+    if (TransformTrees(TREE_MASK, s) != TREE_MASK) {
+      return false;
+    }
+
+    for (u_int o = 0u; o < N_TREES; ++o) {
+      u_int image = SYMMETRY_CELLS[s][o];
+      if (SYMMETRY_CELLS[SYMMETRY_INVERSE[s]][image] != o) {
+        return false;
+      }
+
+      for (u_int d = 0u; d < 6u; ++d) {
+        int8_t n = NEIGHBOR_TABLE[o][d];
+        int8_t expected = n == -1 ? -1 : SYMMETRY_CELLS[s][n];
+        if (NEIGHBOR_TABLE[image][SymmetryDirection(s, d)] != expected) {
+          return false;
+        }
+
+        for (u_int t = 0u; t < 3u; ++t) {
+          if (SHADOW_TABLE[SymmetryDirection(s, d)][t][image] !=
+              TransformTrees(SHADOW_TABLE[d][t][o], s)) {
+            return false;
+          }
+        }
+      }
+
+      for (u_int t = 0u; t < 3u; ++t) {
+        if (SEED_DESTINATIONS[t][image] !=
+            TransformTrees(SEED_DESTINATIONS[t][o], s)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  /* Rotating by 3 steps is the point reflection used to place arid cells. */
+  for (u_int o = 0u; o < N_TREES; ++o) {
+    if (SYMMETRY_CELLS[3][o] != OPPOSITE[o]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static_assert(CheckSymmetries(), "Symmetries disagree with NEIGHBOR_TABLE");
+
+/**
+ * splitmix64 finalizer, maps 0 to 0.
+ */
+inline uint64_t constexpr Mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+struct ZobristKeys {
+  std::array<std::array<std::array<uint64_t, N_TREES>, 4>, 2> tree{};
+  std::array<uint64_t, N_TREES> dormant{};
+  std::array<uint64_t, 2> waiting{};
+};
+
+inline auto constexpr MakeZobristKeys() {
+  ZobristKeys keys{};
+  uint64_t state = 0x5EED5EED5EED5EEDull;
+  auto next = [&]() {
+    state += 0x9E3779B97F4A7C15ull;
+    return Mix64(state);
+  };
+
+  for (auto& player : keys.tree) {
+    for (auto& size : player) {
+      for (auto& key : size) {
+        key = next();
+      }
+    }
+  }
+  for (auto& key : keys.dormant) {
+    key = next();
+  }
+  for (auto& key : keys.waiting) {
+    key = next();
+  }
+
+  return keys;
+}
+
+static auto constexpr ZOBRIST = MakeZobristKeys();
+
+/**
+ * Keys for byte sized counters are mixed on the fly rather than tabled, one
+ * odd multiplier per counter.
+ */
+enum class ZobristField : u_int {
+  kDay,
+  kNutrients,
+  kScore,
+  kSun,
+  kMove,
+  kOrientation
+};
+
+inline uint64_t constexpr ZobristFieldKey(ZobristField field, u_int player,
+                                          uint64_t value) {
+  uint64_t salt = 0x2545F4914F6CDD1Dull +
+                  (static_cast<uint64_t>(field) * 2u + player) *
+                      0x9E3779B97F4A7C16ull;
+  return Mix64(value * (salt | 1u));
+}
+
 template <class Callable>
 inline void IterateTrees(uint64_t trees, Callable&& callable) {
   while (trees != 0) {
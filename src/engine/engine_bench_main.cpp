@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "engine_GameState.hpp"
+#include "engine_GameStateBatch.hpp"
+#include "util_TimeStamp.hpp"
+
+/**
+ * Engine throughput benchmark.
+ *
+ * Perft counts every leaf of the full move tree below a fixed set of
+ * positions, the counts double as a move generation correctness check.
+ * The microbenchmarks time GetMoves, GetMoveSet, Turn, EndDay and
+ * RandomStart over a fixed pool of positions, then whole rollouts played
+ * one game at a time and in lockstep by GameStateBatch.
+ *
+ * Before timing anything, seeded random games check the incrementally
+ * updated Hash() against ComputeHash() after every ply, and every lane of
+ * seeded GameStateBatch rollouts against a GameState playing its moves.
+ *
+ * Usage: bench.exe [--output file] [--baseline file] [--threshold 0.1]
+ * Results are written as JSON. The exit code is 1 if a hash differs from
+ * its recompute, a batch lane from its GameState or, with a baseline (a
+ * previous output), if a perft count differs or a rate dropped by more than
+ * the threshold fraction.
+ */
+
+namespace {
+
+using engine::GameState;
+using engine::Move;
+using util::TimeStamp;
+
+struct Position {
+  GameState state;
+  uint64_t arid;
+};
+
+struct Result {
+  std::string name;
+  uint64_t count;
+  double seconds;
+  uint64_t checksum;
+
+  double Rate() const { return count / seconds; }
+};
+
+/* RandomStart seeds and the number of random plies played from each start,
+ * as the first days are nothing but waits. */
+static std::array<uint32_t, 4> constexpr PERFT_SEEDS = {1u, 2u, 3u, 4u};
+static std::array<u_int, 3> constexpr PERFT_PLIES = {40u, 70u, 100u};
+static u_int constexpr PERFT_DEPTH = 7u;
+
+static u_int constexpr POOL_GAMES = 64u;
+static u_int constexpr MICRO_REPEATS = 128u;
+static u_int constexpr RANDOM_STARTS = 50000u;
+
+static u_int constexpr HASH_GAMES = 256u;
+static u_int constexpr BATCH_GAMES = 256u;
+
+/* Games per rollout benchmark, from the POOL_GAMES starts. */
+static u_int constexpr ROLLOUT_GAMES = 4096u;
+static size_t constexpr LANES = 8u;
+using Batch = engine::GameStateBatch<LANES>;
+
+static u_int constexpr TRIALS = 5u;
+
+/* Rates of runs shorter than this are too noisy to gate on. */
+static double constexpr MIN_GATED_SECONDS = 0.01;
+
+Position PlayRandom(uint32_t seed, u_int n_plies) {
+  Position p;
+  p.state = GameState::RandomStart(p.arid, seed);
+
+  std::mt19937 rand_engine(seed);
+  for (u_int i = 0; i < n_plies && !p.state.IsTerminal(); ++i) {
+    auto player = p.state.NextPlayer();
+    auto moves = p.state.GetMoves(player, p.arid);
+    p.state.Turn(player, moves[rand_engine() % moves.size()], p.arid);
+  }
+
+  return p;
+}
+
+uint64_t Perft(GameState const& g, uint64_t arid, u_int depth) {
+  if (depth == 0 || g.IsTerminal()) {
+    return 1u;
+  }
+
+  uint64_t nodes = 0u;
+  auto player = g.NextPlayer();
+  g.GetMoves(
+      player,
+      [&](Move const& m) {
+        GameState next = g;
+        next.Turn(player, m, arid);
+        nodes += Perft(next, arid, depth - 1);
+      },
+      arid);
+
+  return nodes;
+}
+
+/**
+ * Plays HASH_GAMES seeded random games through Turn, which also runs EndDay,
+ * and reports the first ply whose Hash() differs from ComputeHash().
+ */
+bool CheckHashes() {
+  std::mt19937 rand_engine(0u);
+  for (u_int seed = 0; seed < HASH_GAMES; ++seed) {
+    uint64_t arid;
+    GameState g = GameState::RandomStart(arid, seed);
+
+    for (u_int ply = 0; !g.IsTerminal(); ++ply) {
+      if (g.Hash() != g.ComputeHash()) {
+        std::cerr << "hash: game " << seed << " ply " << ply << " has "
+                  << g.Hash() << ", recomputed " << g.ComputeHash()
+                  << std::endl;
+        return false;
+      }
+
+      auto player = g.NextPlayer();
+      auto moves = g.GetMoves(player, arid);
+      g.Turn(player, moves[rand_engine() % moves.size()], arid);
+    }
+    if (g.Hash() != g.ComputeHash()) {
+      std::cerr << "hash: game " << seed << " ends with " << g.Hash()
+                << ", recomputed " << g.ComputeHash() << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Plays BATCH_GAMES seeded GameStateBatch rollouts, each lane also through
+ * GameState::Turn, and reports the first move that is illegal or leaves the
+ * lane different from its GameState. Lanes are compared after each of their
+ * turns within a day and after every EndDay.
+ */
+bool CheckBatch() {
+  std::mt19937 rand_engine(0u);
+  auto rand_func = [&]() { return static_cast<int>(rand_engine() >> 1); };
+  for (u_int seed = 0; seed < BATCH_GAMES; ++seed) {
+    /* Start from every stage of the game. */
+    Position p = PlayRandom(seed, seed % 120u);
+    Batch batch(p.state, p.arid);
+    std::array<GameState, LANES> lanes;
+    lanes.fill(p.state);
+
+    while (!batch.IsTerminal()) {
+      for (size_t l = 0; l < LANES; ++l) {
+        GameState& g = lanes[l];
+        /* GameState ends the day itself on the second wait. */
+        while (g.GetDay() == batch.GetDay()) {
+          auto player = batch.NextPlayer(l);
+          Move m = batch.SampleRolloutMove(l, player, rand_func);
+          auto legal = g.GetMoves(g.NextPlayer(), p.arid);
+          bool is_legal = player == g.NextPlayer() &&
+                          std::any_of(legal.begin(), legal.end(),
+                                      [&](Move const& other) {
+                                        return Move::ToInt(other) ==
+                                               Move::ToInt(m);
+                                      });
+          if (!is_legal) {
+            std::cerr << "batch: game " << seed << " lane " << l << " day "
+                      << static_cast<u_int>(g.GetDay()) << " illegal " << m
+                      << std::endl;
+            return false;
+          }
+
+          batch.Turn(l, player, m);
+          g.Turn(player, m, p.arid);
+          if (g.GetDay() == batch.GetDay() && !(batch.Get(l) == g)) {
+            std::cerr << "batch: game " << seed << " lane " << l << " day "
+                      << static_cast<u_int>(g.GetDay()) << " differs after "
+                      << m << std::endl;
+            return false;
+          }
+        }
+      }
+
+      batch.EndDay();
+      for (size_t l = 0; l < LANES; ++l) {
+        if (!(batch.Get(l) == lanes[l])) {
+          std::cerr << "batch: game " << seed << " lane " << l
+                    << " differs after day "
+                    << static_cast<u_int>(batch.GetDay()) - 1u << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * The rollout policy of Mcts::GetRolloutMoves, which GameStateBatch samples
+ * from its bitboards.
+ */
+engine::MoveSet RolloutMoves(GameState const& g, uint64_t arid) {
+  auto params = GameState::MoveFilterParams::Default();
+  params.can_seed = g.GetNumTrees(g.NextPlayer(), 0) == 0;
+
+  uint8_t day = g.GetDay();
+  if (day < 11) {
+    params.can_complete = false;
+  } else if (day < 22) {
+    params.can_complete = g.GetNumTrees(g.NextPlayer(), 3) >= 4;
+  }
+  if (day > 19) {
+    params.can_grow = false;
+  }
+
+  return GameState::DispatchMoveFilter(params, [&](auto filter) {
+    auto moves = g.GetMoveSet<decltype(filter)>(g.NextPlayer(), arid);
+    moves.KeepPreferred();
+    return moves;
+  });
+}
+
+/**
+ * Every state of POOL_GAMES seeded random games, with one legal move each.
+ */
+void MakePool(std::vector<Position>& positions, std::vector<Move>& moves) {
+  std::mt19937 rand_engine(0u);
+  for (u_int seed = 0; seed < POOL_GAMES; ++seed) {
+    Position p;
+    p.state = GameState::RandomStart(p.arid, seed);
+
+    while (!p.state.IsTerminal()) {
+      auto player = p.state.NextPlayer();
+      auto legal = p.state.GetMoves(player, p.arid);
+      auto m = legal[rand_engine() % legal.size()];
+
+      positions.push_back(p);
+      moves.push_back(m);
+      p.state.Turn(player, m, p.arid);
+    }
+  }
+}
+
+/**
+ * Best of TRIALS runs, the fastest run being the one least disturbed by
+ * whatever else the machine is doing.
+ */
+template <class Body>
+Result Time(std::string const& name, uint64_t count, Body&& body) {
+  Result r{name, count, 0.0, 0u};
+  for (u_int t = 0; t < TRIALS; ++t) {
+    TimeStamp start;
+    r.checksum = body();
+    double seconds = start.Since();
+    if (t == 0 || seconds < r.seconds) {
+      r.seconds = seconds;
+    }
+  }
+  return r;
+}
+
+std::vector<Result> Run() {
+  std::vector<Result> results;
+
+  std::vector<Position> perft_positions;
+  for (auto seed : PERFT_SEEDS) {
+    for (auto plies : PERFT_PLIES) {
+      perft_positions.push_back(PlayRandom(seed, plies));
+    }
+  }
+
+  for (u_int depth = 1; depth <= PERFT_DEPTH; ++depth) {
+    auto r = Time("perft_" + std::to_string(depth), 0u, [&]() {
+      uint64_t nodes = 0u;
+      for (auto const& p : perft_positions) {
+        nodes += Perft(p.state, p.arid, depth);
+      }
+      return nodes;
+    });
+    r.count = r.checksum;
+    results.push_back(r);
+  }
+
+  std::vector<Position> pool;
+  std::vector<Move> pool_moves;
+  MakePool(pool, pool_moves);
+  uint64_t n_calls = pool.size() * MICRO_REPEATS;
+
+  results.push_back(Time("get_moves", n_calls, [&]() {
+    uint64_t sum = 0u;
+    for (u_int r = 0; r < MICRO_REPEATS; ++r) {
+      for (auto const& p : pool) {
+        sum += p.state.GetMoves(p.state.NextPlayer(), p.arid).size();
+      }
+    }
+    return sum;
+  }));
+
+  results.push_back(Time("get_move_set", n_calls, [&]() {
+    uint64_t sum = 0u;
+    for (u_int r = 0; r < MICRO_REPEATS; ++r) {
+      for (auto const& p : pool) {
+        sum += p.state.GetMoveSet(p.state.NextPlayer(), p.arid).Count();
+      }
+    }
+    return sum;
+  }));
+
+  results.push_back(Time("turn", n_calls, [&]() {
+    uint64_t sum = 0u;
+    for (u_int r = 0; r < MICRO_REPEATS; ++r) {
+      for (size_t i = 0; i < pool.size(); ++i) {
+        GameState g = pool[i].state;
+        g.Turn(g.NextPlayer(), pool_moves[i], pool[i].arid);
+        sum += g.Hash();
+      }
+    }
+    return sum;
+  }));
+
+  /* EndDay is private, time it through the wait that closes the day. */
+  std::vector<Position> day_ends;
+  for (auto const& p : pool) {
+    if (p.state.IsWaiting(1u - p.state.NextPlayer())) {
+      day_ends.push_back(p);
+    }
+  }
+  results.push_back(
+      Time("end_day", day_ends.size() * MICRO_REPEATS, [&]() {
+        uint64_t sum = 0u;
+        for (u_int r = 0; r < MICRO_REPEATS; ++r) {
+          for (auto const& p : day_ends) {
+            GameState g = p.state;
+            g.Turn(g.NextPlayer(), Move::Wait(), p.arid);
+            sum += g.Hash();
+          }
+        }
+        return sum;
+      }));
+
+  std::vector<Position> starts;
+  for (u_int seed = 0; seed < POOL_GAMES; ++seed) {
+    starts.push_back(PlayRandom(seed, 0u));
+  }
+
+  results.push_back(Time("rollout", ROLLOUT_GAMES, [&]() {
+    std::mt19937 rand_engine(0u);
+    auto rand_func = [&]() { return static_cast<int>(rand_engine() >> 1); };
+    uint64_t sum = 0u;
+    for (u_int i = 0; i < ROLLOUT_GAMES; ++i) {
+      auto const& p = starts[i % starts.size()];
+      GameState g = p.state;
+      while (!g.IsTerminal()) {
+        g.Turn(g.NextPlayer(), RolloutMoves(g, p.arid).Sample(rand_func),
+               p.arid);
+      }
+      sum += g.GetScore(0) + g.GetScore(1);
+    }
+    return sum;
+  }));
+
+  results.push_back(
+      Time("batch_rollout_" + std::to_string(LANES), ROLLOUT_GAMES, [&]() {
+        std::mt19937 rand_engine(0u);
+        auto rand_func = [&]() {
+          return static_cast<int>(rand_engine() >> 1);
+        };
+        uint64_t sum = 0u;
+        for (u_int i = 0; i < ROLLOUT_GAMES / LANES; ++i) {
+          auto const& p = starts[i % starts.size()];
+          Batch batch(p.state, p.arid);
+          batch.Rollout(rand_func);
+          for (size_t l = 0; l < LANES; ++l) {
+            sum += batch.GetScore(l, 0) + batch.GetScore(l, 1);
+          }
+        }
+        return sum;
+      }));
+
+  results.push_back(Time("random_start", RANDOM_STARTS, [&]() {
+    uint64_t sum = 0u;
+    for (u_int i = 0; i < RANDOM_STARTS; ++i) {
+      uint64_t arid;
+      sum += GameState::RandomStart(arid, i).Hash() ^ arid;
+    }
+    return sum;
+  }));
+
+  return results;
+}
+
+void WriteJson(std::ostream& out, std::vector<Result> const& results) {
+  out << "{\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto const& r = results[i];
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "    {\"name\": \"%s\", \"count\": %llu, \"seconds\": %.6f, "
+                  "\"rate\": %.1f, \"checksum\": %llu}%s\n",
+                  r.name.c_str(), static_cast<unsigned long long>(r.count),
+                  r.seconds, r.Rate(),
+                  static_cast<unsigned long long>(r.checksum),
+                  i + 1 < results.size() ? "," : "");
+    out << line;
+  }
+  out << "  ]\n}\n";
+}
+
+/**
+ * Reads back the name, count and seconds of each benchmark WriteJson wrote.
+ */
+std::map<std::string, Result> ReadJson(std::istream& in) {
+  std::map<std::string, Result> results;
+  std::string line;
+  while (std::getline(in, line)) {
+    char name[128];
+    unsigned long long count;
+    double seconds, rate;
+    if (std::sscanf(line.c_str(),
+                    " {\"name\": \"%127[^\"]\", \"count\": %llu, \"seconds\": "
+                    "%lf, \"rate\": %lf",
+                    name, &count, &seconds, &rate) == 4) {
+      results[name] = Result{name, count, seconds, 0u};
+    }
+  }
+  return results;
+}
+
+bool Compare(std::vector<Result> const& results,
+             std::map<std::string, Result> const& baseline, double threshold) {
+  bool ok = true;
+  for (auto const& r : results) {
+    auto it = baseline.find(r.name);
+    if (it == baseline.end()) {
+      continue;
+    }
+    auto const& b = it->second;
+
+    if (r.name.rfind("perft", 0) == 0 && r.count != b.count) {
+      std::cerr << r.name << ": " << r.count << " nodes, expected " << b.count
+                << std::endl;
+      ok = false;
+    }
+
+    if (b.seconds < MIN_GATED_SECONDS) {
+      continue;
+    }
+
+    double change = r.Rate() / b.Rate() - 1.0;
+    std::cerr << r.name << ": " << static_cast<int>(change * 100.0) << "%"
+              << std::endl;
+    if (change < -threshold) {
+      std::cerr << r.name << ": regressed beyond " << threshold * 100.0 << "%"
+                << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string output, baseline;
+  double threshold = 0.1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--output") == 0) {
+      output = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--baseline") == 0) {
+      baseline = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--threshold") == 0) {
+      threshold = std::stod(argv[i + 1]);
+    } else {
+      std::cerr << "unknown argument " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+
+  if (!CheckHashes() || !CheckBatch()) {
+    return 1;
+  }
+
+  auto results = Run();
+
+  if (output.empty()) {
+    WriteJson(std::cout, results);
+  } else {
+    std::ofstream out(output);
+    WriteJson(out, results);
+  }
+
+  if (!baseline.empty()) {
+    std::ifstream in(baseline);
+    if (!in) {
+      std::cerr << "can't read " << baseline << std::endl;
+      return 2;
+    }
+    return Compare(results, ReadJson(in), threshold) ? 0 : 1;
+  }
+
+  return 0;
+}
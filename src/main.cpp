@@ -1,6 +1,7 @@
 #include <deque>
 #include <fstream>
 #include <iostream>
+#include <utility>
 
 #include "agent_Mcts.hpp"
 #include "agent_NeuralMcts.hpp"
@@ -75,6 +76,9 @@ int main() {
     std::default_random_engine e(std::random_device{}());
     std::uniform_int_distribution<size_t> uni_train(0, training_samples.size());
     auto rand_fn = [&]() { return uni_train(e); };
+    std::uniform_int_distribution<u_int> uni_symmetry(
+        0, engine::N_SYMMETRIES - 1);
+    auto symmetry_fn = [&]() { return uni_symmetry(e); };
 
     float loss_sum = 0.0f;
     for (u_int b = 0; b < N_TRAIN_STEPS; ++b) {
@@ -83,11 +87,13 @@ int main() {
         batch[i] = &training_samples[rand_fn()];
       }
 
-      auto features = agent::NeuralHeuristic::ToFeatures(batch);
+      auto features =
+          agent::NeuralHeuristic::ToAugmentedFeatures(batch, symmetry_fn);
       auto truth = agent::NeuralHeuristic::ToExpected(batch);
       float loss = learning->network().Batch(features, truth, LEARN_RATE);
       loss_sum += loss;
     }
+    learning->Freeze();
 
     best_factory->SetEpsilon(0.0f);
     learn_factory->SetEpsilon(0.0f);
@@ -124,8 +130,8 @@ int main() {
       std::cout << "Swapping Model!" << std::endl;
       best = learning->Clone();
       best_factory = std::make_unique<NeuralAgentFactory>(best.get());
-      best->network().SaveToFile("model_swap_" + std::to_string(epoch) +
-                                 ".bin");
+      std::as_const(*best).network().SaveToFile(
+          "model_swap_" + std::to_string(epoch) + ".bin");
     }
 
     epoch++;
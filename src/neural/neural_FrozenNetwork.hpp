@@ -0,0 +1,294 @@
+#ifndef __INCLUDE_GUARD_NEURAL_FROZEN_NETWORK
+#define __INCLUDE_GUARD_NEURAL_FROZEN_NETWORK
+
+#include <algorithm>
+#include <array>
+#include <memory>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "neural_Linear.hpp"
+#include "neural_Network.hpp"
+#include "neural_ReLU.hpp"
+#include "util_General.hpp"
+
+namespace neural {
+
+/**
+ * Weights of a Linear layer with kInput x kOutput weights, for one input.
+ */
+template <u_int kInput, u_int kOutput>
+class FrozenLinear {
+ public:
+  explicit FrozenLinear(Linear const& linear) {
+    ASSERT(linear.w().shape()[0] == kInput);
+    ASSERT(linear.w().shape()[1] == kOutput);
+
+    std::copy_n(linear.w().data(), kInput * kOutput, w_.begin());
+    std::copy_n(linear.b().data(), kOutput, b_.begin());
+  }
+
+  /**
+   * output = input * w + b, followed by a ReLU if kRelu.
+   */
+  template <bool kRelu>
+  void Forward(float const* input, float* output) const {
+#ifdef __AVX2__
+    if constexpr (kOutput % kLanes == 0u) {
+      ForwardAvx<kRelu>(input, output);
+      return;
+    }
+#endif
+    std::array<float, kOutput> sum = b_;
+    for (u_int i = 0u; i < kInput; ++i) {
+      float x = input[i];
+      float const* row = w_.data() + i * kOutput;
+      for (u_int j = 0u; j < kOutput; ++j) {
+        sum[j] += x * row[j];
+      }
+    }
+
+    for (u_int j = 0u; j < kOutput; ++j) {
+      output[j] = kRelu ? std::max(sum[j], 0.0f) : sum[j];
+    }
+  }
+
+  /**
+   * accumulator = b, the output before the ReLU for an all zero input.
+   */
+  void Reset(float* accumulator) const {
+    std::copy(b_.begin(), b_.end(), accumulator);
+  }
+
+  /**
+   * Adds delta times the weights of input i to an output before the ReLU.
+   */
+  void Add(u_int i, float delta, float* accumulator) const {
+    float const* row = w_.data() + i * kOutput;
+    for (u_int j = 0u; j < kOutput; ++j) {
+      accumulator[j] += delta * row[j];
+    }
+  }
+
+ private:
+  static u_int constexpr kLanes = 8u;
+  static u_int constexpr kVectors = kOutput / kLanes;
+
+#ifdef __AVX2__
+  /**
+   * Keeps the outputs in registers, two sets of them over even and odd
+   * inputs so consecutive FMAs do not wait on each other.
+   */
+  template <bool kRelu>
+  void ForwardAvx(float const* input, float* output) const {
+    __m256 even[kVectors];
+    __m256 odd[kVectors];
+    for (u_int v = 0u; v < kVectors; ++v) {
+      even[v] = _mm256_load_ps(b_.data() + v * kLanes);
+      odd[v] = _mm256_setzero_ps();
+    }
+
+    u_int i = 0u;
+    for (; i + 2u <= kInput; i += 2u) {
+      __m256 x0 = _mm256_broadcast_ss(input + i);
+      __m256 x1 = _mm256_broadcast_ss(input + i + 1u);
+      float const* row = w_.data() + i * kOutput;
+      for (u_int v = 0u; v < kVectors; ++v) {
+        even[v] = _mm256_fmadd_ps(x0, _mm256_load_ps(row + v * kLanes),
+                                  even[v]);
+        odd[v] = _mm256_fmadd_ps(
+            x1, _mm256_load_ps(row + kOutput + v * kLanes), odd[v]);
+      }
+    }
+    if (i < kInput) {
+      __m256 x0 = _mm256_broadcast_ss(input + i);
+      float const* row = w_.data() + i * kOutput;
+      for (u_int v = 0u; v < kVectors; ++v) {
+        even[v] = _mm256_fmadd_ps(x0, _mm256_load_ps(row + v * kLanes),
+                                  even[v]);
+      }
+    }
+
+    for (u_int v = 0u; v < kVectors; ++v) {
+      __m256 sum = _mm256_add_ps(even[v], odd[v]);
+      if (kRelu) {
+        sum = _mm256_max_ps(sum, _mm256_setzero_ps());
+      }
+      _mm256_storeu_ps(output + v * kLanes, sum);
+    }
+  }
+#endif
+
+  alignas(32) std::array<float, kInput * kOutput> w_;
+  alignas(32) std::array<float, kOutput> b_;
+};
+
+/**
+ * Linear layers kDims[0] -> kDims[1] -> ..., each but the last followed by
+ * a ReLU.
+ */
+template <u_int kInput, u_int kOutput, u_int... kRest>
+class FrozenLayers {
+ public:
+  static u_int constexpr kInputDimensions = kInput;
+  static u_int constexpr kAccumulatorDimensions = kOutput;
+  static u_int constexpr kOutputDimensions =
+      FrozenLayers<kOutput, kRest...>::kOutputDimensions;
+
+  explicit FrozenLayers(std::unique_ptr<ILayer> const* layers)
+      : linear_(static_cast<Linear const&>(*layers[0])), rest_(layers + 2) {}
+
+  void Forward(float const* input, float* output) const {
+    alignas(32) std::array<float, kOutput> hidden;
+    linear_.template Forward<true>(input, hidden.data());
+    rest_.Forward(hidden.data(), output);
+  }
+
+  /**
+   * Forward from the first layer's output before its ReLU.
+   */
+  void ForwardAccumulator(float const* accumulator, float* output) const {
+    alignas(32) std::array<float, kOutput> hidden;
+    for (u_int j = 0u; j < kOutput; ++j) {
+      hidden[j] = std::max(accumulator[j], 0.0f);
+    }
+    rest_.Forward(hidden.data(), output);
+  }
+
+  FrozenLinear<kInput, kOutput> const& first() const { return linear_; }
+
+ private:
+  FrozenLinear<kInput, kOutput> linear_;
+  FrozenLayers<kOutput, kRest...> rest_;
+};
+
+template <u_int kInput, u_int kOutput>
+class FrozenLayers<kInput, kOutput> {
+ public:
+  static u_int constexpr kInputDimensions = kInput;
+  static u_int constexpr kAccumulatorDimensions = kOutput;
+  static u_int constexpr kOutputDimensions = kOutput;
+
+  explicit FrozenLayers(std::unique_ptr<ILayer> const* layers)
+      : linear_(static_cast<Linear const&>(*layers[0])) {}
+
+  void Forward(float const* input, float* output) const {
+    linear_.template Forward<false>(input, output);
+  }
+
+  void ForwardAccumulator(float const* accumulator, float* output) const {
+    std::copy_n(accumulator, kOutput, output);
+  }
+
+  FrozenLinear<kInput, kOutput> const& first() const { return linear_; }
+
+ private:
+  FrozenLinear<kInput, kOutput> linear_;
+};
+
+/**
+ * Inference only copy of a Network of Linear layers with the dimensions
+ * kDims and a ReLU between each two, e.g. FrozenNetwork<118, 32, 24, 16, 1>.
+ *
+ * The shapes are compile time constants, so Forward runs on stack buffers
+ * without allocating and each Linear is fused with the ReLU after it. A
+ * change to the Network's weights needs a new copy.
+ *
+ * The first layer's output before its ReLU, the accumulator, can also be
+ * kept up to date as inputs change: ResetAccumulator gives it for an all
+ * zero input, Accumulate adds a change of one input and ForwardAccumulator
+ * runs the remaining layers from it.
+ */
+template <u_int... kDims>
+class FrozenNetwork {
+ public:
+  static u_int constexpr kInputDimensions =
+      FrozenLayers<kDims...>::kInputDimensions;
+  static u_int constexpr kAccumulatorDimensions =
+      FrozenLayers<kDims...>::kAccumulatorDimensions;
+  static u_int constexpr kOutputDimensions =
+      FrozenLayers<kDims...>::kOutputDimensions;
+
+  explicit FrozenNetwork(Network const& network)
+      : layers_(Layers(network)) {}
+
+  /**
+   * Whether network has the layers and dimensions of this FrozenNetwork.
+   */
+  static bool Matches(Network const& network) {
+    std::array<u_int, sizeof...(kDims)> dims = {kDims...};
+    auto const& layers = network.layers();
+    if (layers.size() != 2u * dims.size() - 3u) {
+      return false;
+    }
+
+    for (size_t l = 0u; l < layers.size(); ++l) {
+      if (l % 2u == 1u) {
+        if (dynamic_cast<ReLU const*>(layers[l].get()) == nullptr) {
+          return false;
+        }
+        continue;
+      }
+
+      auto const* linear = dynamic_cast<Linear const*>(layers[l].get());
+      if (linear == nullptr || linear->w().shape()[0] != dims[l / 2u] ||
+          linear->w().shape()[1] != dims[l / 2u + 1u] ||
+          linear->b().shape()[0] != 1u ||
+          linear->b().shape()[1] != dims[l / 2u + 1u]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Writes the kOutputDimensions outputs for the kInputDimensions inputs.
+   */
+  void Forward(float const* input, float* output) const {
+    layers_.Forward(input, output);
+  }
+
+  float Forward(float const* input) const {
+    static_assert(kOutputDimensions == 1u);
+    float output;
+    Forward(input, &output);
+    return output;
+  }
+
+  void ResetAccumulator(float* accumulator) const {
+    layers_.first().Reset(accumulator);
+  }
+
+  /**
+   * Adds delta to the input at index to the kAccumulatorDimensions values
+   * of accumulator.
+   */
+  void Accumulate(u_int index, float delta, float* accumulator) const {
+    layers_.first().Add(index, delta, accumulator);
+  }
+
+  void ForwardAccumulator(float const* accumulator, float* output) const {
+    layers_.ForwardAccumulator(accumulator, output);
+  }
+
+  float ForwardAccumulator(float const* accumulator) const {
+    static_assert(kOutputDimensions == 1u);
+    float output;
+    ForwardAccumulator(accumulator, &output);
+    return output;
+  }
+
+ private:
+  static std::unique_ptr<ILayer> const* Layers(Network const& network) {
+    ASSERT(Matches(network));
+    return network.layers().data();
+  }
+
+  FrozenLayers<kDims...> layers_;
+};
+
+}  // namespace neural
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef __INCLUDE_GUARD_NEURAL_GEMM
+#define __INCLUDE_GUARD_NEURAL_GEMM
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "util_General.hpp"
+
+namespace neural {
+
+/**
+ * Adds op(left) * op(right) to the row major m x n output, where op(left) is
+ * m x k and op(right) is k x n. A transposed operand is read in place from
+ * its stored layout, left as k x m and right as n x k.
+ */
+template <class T>
+void Gemm(bool transpose_left, bool transpose_right, u_int m, u_int n,
+          u_int k, T const* left, T const* right, T* output) {
+  for (u_int i = 0u; i < m; ++i) {
+    for (u_int p = 0u; p < k; ++p) {
+      T l = transpose_left ? left[p * m + i] : left[i * k + p];
+      for (u_int j = 0u; j < n; ++j) {
+        output[i * n + j] +=
+            l * (transpose_right ? right[j * k + p] : right[p * n + j]);
+      }
+    }
+  }
+}
+
+/**
+ * Cache blocked float Gemm. Blocks of op(right) (kKc x kNc) and op(left)
+ * (kMc x kKc) are packed into panels the micro kernel streams through, it
+ * keeps a kMr x kNr block of the output in registers (12 AVX2 accumulators).
+ * Outputs narrower than kNarrow columns or with fewer than kMr rows are too
+ * small to pay for the padded panels and run as dot products or rows times
+ * matrix instead.
+ */
+class FloatGemm {
+ public:
+  static void Run(bool transpose_left, bool transpose_right, u_int m, u_int n,
+                  u_int k, float const* left, float const* right,
+                  float* output) {
+    if (m == 0u || n == 0u || k == 0u) {
+      return;
+    }
+    if (n < kNarrow) {
+      RunColumns(transpose_left, transpose_right, m, n, k, left, right,
+                 output);
+      return;
+    }
+    if (m < kMr) {
+      RunRows(transpose_left, transpose_right, m, n, k, left, right, output);
+      return;
+    }
+
+    static thread_local std::vector<float> packed_left;
+    static thread_local std::vector<float> packed_right;
+    packed_left.resize(kMc * kKc);
+    packed_right.resize(kKc * kNc);
+
+    for (u_int jc = 0u; jc < n; jc += kNc) {
+      u_int nc = std::min(kNc, n - jc);
+      for (u_int pc = 0u; pc < k; pc += kKc) {
+        u_int kc = std::min(kKc, k - pc);
+        PackRight(transpose_right, n, k, right, pc, kc, jc, nc,
+                  packed_right.data());
+
+        for (u_int ic = 0u; ic < m; ic += kMc) {
+          u_int mc = std::min(kMc, m - ic);
+          PackLeft(transpose_left, m, k, left, ic, mc, pc, kc,
+                   packed_left.data());
+
+          for (u_int jr = 0u; jr < nc; jr += kNr) {
+            for (u_int ir = 0u; ir < mc; ir += kMr) {
+              Kernel(kc, packed_left.data() + ir * kc,
+                     packed_right.data() + jr * kc,
+                     output + (ic + ir) * n + jc + jr, n,
+                     std::min(kMr, mc - ir), std::min(kNr, nc - jr));
+            }
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  static u_int constexpr kMr = 6u;
+  static u_int constexpr kNr = 16u;
+  static u_int constexpr kKc = 256u;
+  static u_int constexpr kMc = 16u * kMr;
+  static u_int constexpr kNc = 256u;
+  static u_int constexpr kNarrow = 4u;
+
+  /**
+   * Rows [ic, ic + mc) and columns [pc, pc + kc) of op(left) as kMr row
+   * panels, each k major, short panels padded with zeros.
+   */
+  static void PackLeft(bool transpose, u_int m, u_int k, float const* left,
+                       u_int ic, u_int mc, u_int pc, u_int kc, float* packed) {
+    for (u_int ir = 0u; ir < mc; ir += kMr) {
+      for (u_int p = 0u; p < kc; ++p) {
+        for (u_int r = 0u; r < kMr; ++r) {
+          u_int i = ic + ir + r;
+          float v = 0.0f;
+          if (ir + r < mc) {
+            v = transpose ? left[(pc + p) * m + i] : left[i * k + pc + p];
+          }
+          *packed++ = v;
+        }
+      }
+    }
+  }
+
+  /**
+   * Rows [pc, pc + kc) and columns [jc, jc + nc) of op(right) as kNr column
+   * panels, each k major, short panels padded with zeros.
+   */
+  static void PackRight(bool transpose, u_int n, u_int k, float const* right,
+                        u_int pc, u_int kc, u_int jc, u_int nc,
+                        float* packed) {
+    for (u_int jr = 0u; jr < nc; jr += kNr) {
+      for (u_int p = 0u; p < kc; ++p) {
+        for (u_int c = 0u; c < kNr; ++c) {
+          u_int j = jc + jr + c;
+          float v = 0.0f;
+          if (jr + c < nc) {
+            v = transpose ? right[j * k + pc + p] : right[(pc + p) * n + j];
+          }
+          *packed++ = v;
+        }
+      }
+    }
+  }
+
+  /**
+   * Adds a kMr x kNr panel product to the rows x cols block at output.
+   */
+  static void Kernel(u_int kc, float const* left, float const* right,
+                     float* output, u_int stride, u_int rows, u_int cols) {
+#ifdef __AVX2__
+    __m256 acc[kMr][2];
+    for (u_int r = 0u; r < kMr; ++r) {
+      acc[r][0] = _mm256_setzero_ps();
+      acc[r][1] = _mm256_setzero_ps();
+    }
+
+    for (u_int p = 0u; p < kc; ++p) {
+      __m256 r0 = _mm256_loadu_ps(right + p * kNr);
+      __m256 r1 = _mm256_loadu_ps(right + p * kNr + 8u);
+      for (u_int r = 0u; r < kMr; ++r) {
+        __m256 l = _mm256_broadcast_ss(left + p * kMr + r);
+        acc[r][0] = _mm256_fmadd_ps(l, r0, acc[r][0]);
+        acc[r][1] = _mm256_fmadd_ps(l, r1, acc[r][1]);
+      }
+    }
+
+    if (rows == kMr && cols == kNr) {
+      for (u_int r = 0u; r < kMr; ++r) {
+        float* out = output + r * stride;
+        _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), acc[r][0]));
+        _mm256_storeu_ps(out + 8u,
+                         _mm256_add_ps(_mm256_loadu_ps(out + 8u), acc[r][1]));
+      }
+      return;
+    }
+
+    alignas(32) float tile[kMr][kNr];
+    for (u_int r = 0u; r < kMr; ++r) {
+      _mm256_store_ps(tile[r], acc[r][0]);
+      _mm256_store_ps(tile[r] + 8u, acc[r][1]);
+    }
+#else
+    float tile[kMr][kNr] = {};
+    for (u_int p = 0u; p < kc; ++p) {
+      for (u_int r = 0u; r < kMr; ++r) {
+        for (u_int c = 0u; c < kNr; ++c) {
+          tile[r][c] += left[p * kMr + r] * right[p * kNr + c];
+        }
+      }
+    }
+#endif
+    for (u_int r = 0u; r < rows; ++r) {
+      for (u_int c = 0u; c < cols; ++c) {
+        output[r * stride + c] += tile[r][c];
+      }
+    }
+  }
+
+  /**
+   * Each output row as a row of op(left) times op(right), for inputs too
+   * short to pay for the packing.
+   */
+  static void RunRows(bool transpose_left, bool transpose_right, u_int m,
+                      u_int n, u_int k, float const* left, float const* right,
+                      float* output) {
+    static thread_local std::vector<float> row;
+    row.resize(k);
+
+    for (u_int i = 0u; i < m; ++i) {
+      for (u_int p = 0u; p < k; ++p) {
+        row[p] = transpose_left ? left[p * m + i] : left[i * k + p];
+      }
+
+      float* out = output + i * n;
+      if (transpose_right) {
+        for (u_int j = 0u; j < n; ++j) {
+          out[j] += Dot(row.data(), right + j * k, k);
+        }
+      } else {
+        for (u_int p = 0u; p < k; ++p) {
+          float l = row[p];
+          float const* r = right + p * n;
+          for (u_int j = 0u; j < n; ++j) {
+            out[j] += l * r[j];
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Each output as the dot product of a row of op(left) and a column of
+   * op(right), copied to be contiguous where they are not stored so.
+   */
+  static void RunColumns(bool transpose_left, bool transpose_right, u_int m,
+                         u_int n, u_int k, float const* left,
+                         float const* right, float* output) {
+    static thread_local std::vector<float> row;
+    static thread_local std::vector<float> columns;
+
+    float const* column_data = right;
+    if (!transpose_right && n > 1u) {
+      columns.resize(n * k);
+      for (u_int j = 0u; j < n; ++j) {
+        for (u_int p = 0u; p < k; ++p) {
+          columns[j * k + p] = right[p * n + j];
+        }
+      }
+      column_data = columns.data();
+    }
+
+    row.resize(k);
+    for (u_int i = 0u; i < m; ++i) {
+      float const* row_data = left + i * k;
+      if (transpose_left) {
+        for (u_int p = 0u; p < k; ++p) {
+          row[p] = left[p * m + i];
+        }
+        row_data = row.data();
+      }
+      for (u_int j = 0u; j < n; ++j) {
+        output[i * n + j] += Dot(row_data, column_data + j * k, k);
+      }
+    }
+  }
+
+  static float Dot(float const* x, float const* y, u_int k) {
+    u_int p = 0u;
+    float sum = 0.0f;
+#ifdef __AVX2__
+    __m256 acc = _mm256_setzero_ps();
+    for (; p + 8u <= k; p += 8u) {
+      acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + p), _mm256_loadu_ps(y + p),
+                            acc);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                             _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    sum = _mm_cvtss_f32(half);
+#endif
+    for (; p < k; ++p) {
+      sum += x[p] * y[p];
+    }
+    return sum;
+  }
+};
+
+inline void Gemm(bool transpose_left, bool transpose_right, u_int m, u_int n,
+                 u_int k, float const* left, float const* right,
+                 float* output) {
+  FloatGemm::Run(transpose_left, transpose_right, m, n, k, left, right,
+                 output);
+}
+
+}  // namespace neural
+
+#endif
@@ -37,8 +37,8 @@ class Linear : public ILayer {
 
   FloatTensor Backwards(FloatTensor const& output_gradient,
                         float learn_rate) override {
-    auto input_gradient = MatMul(output_gradient, w_.transpose());
-    auto weight_gradient = MatMul(input_.transpose(), output_gradient);
+    auto input_gradient = MatMulNT(output_gradient, w_);
+    auto weight_gradient = MatMulTN(input_, output_gradient);
 
     w_ -= weight_gradient * learn_rate;
     b_ -= Sum(output_gradient * learn_rate);
@@ -46,6 +46,9 @@ class Linear : public ILayer {
     return input_gradient;
   }
 
+  FloatTensor const& w() const { return w_; }
+  FloatTensor const& b() const { return b_; }
+
   void Serialize(std::ostream& out) const override {
     char byte = 'L';
     out.write(&byte, 1);
@@ -7,6 +7,7 @@
 #include <stdexcept>
 #include <vector>
 
+#include "neural_Gemm.hpp"
 #include "util_General.hpp"
 
 namespace neural {
@@ -40,6 +41,10 @@ class Matrix {
 
   std::array<u_int, 2> const& shape() const { return dimensions_; }
 
+  /* Row major elements. */
+  T const* data() const { return storage_.data(); }
+  T* data() { return storage_.data(); }
+
   u_int constexpr size() const { return dimensions_[0] * dimensions_[1]; }
 
   T value() const {
@@ -149,7 +154,7 @@ T Dot(Matrix<T> const& left, Matrix<T> const& right) {
   ASSERT(SizeEqual(left.shape(), right.shape()));
   ASSERT(left.shape()[1] == 1);
 
-  return MatMul(left.transpose(), right).value();
+  return MatMulTN(left, right).value();
 }
 
 template <class T>
@@ -157,15 +162,34 @@ Matrix<T> MatMul(Matrix<T> const& left, Matrix<T> const& right) {
   ASSERT(left.shape()[1] == right.shape()[0]);
 
   Matrix<T> result(left.shape()[0], right.shape()[1]);
+  Gemm(false, false, left.shape()[0], right.shape()[1], left.shape()[1],
+       left.data(), right.data(), result.data());
+  return result;
+}
 
-  for (u_int r_c = 0u; r_c < right.shape()[1]; ++r_c) {
-    for (u_int l_r = 0u; l_r < left.shape()[0]; ++l_r) {
-      for (u_int l_c = 0u; l_c < left.shape()[1]; ++l_c) {
-        result.Get(l_r, r_c) += left.Get(l_r, l_c) * right.Get(l_c, r_c);
-      }
-    }
-  }
+/**
+ * MatMul(left.transpose(), right) without the copy.
+ */
+template <class T>
+Matrix<T> MatMulTN(Matrix<T> const& left, Matrix<T> const& right) {
+  ASSERT(left.shape()[0] == right.shape()[0]);
+
+  Matrix<T> result(left.shape()[1], right.shape()[1]);
+  Gemm(true, false, left.shape()[1], right.shape()[1], left.shape()[0],
+       left.data(), right.data(), result.data());
+  return result;
+}
+
+/**
+ * MatMul(left, right.transpose()) without the copy.
+ */
+template <class T>
+Matrix<T> MatMulNT(Matrix<T> const& left, Matrix<T> const& right) {
+  ASSERT(left.shape()[1] == right.shape()[1]);
 
+  Matrix<T> result(left.shape()[0], right.shape()[0]);
+  Gemm(false, true, left.shape()[0], right.shape()[0], left.shape()[1],
+       left.data(), right.data(), result.data());
   return result;
 }
 
@@ -3,12 +3,15 @@
 
 #include <fstream>
 #include <memory>
+#include <sstream>
 #include <vector>
 
 #include "neural_ILayer.hpp"
 #include "neural_ILoss.hpp"
 #include "neural_Linear.hpp"
 #include "neural_Matrix.hpp"
+#include "neural_MeanSquareError.hpp"
+#include "neural_QuantizedLinear.hpp"
 #include "neural_ReLU.hpp"
 #include "neural_Tanh.hpp"
 
@@ -66,6 +69,39 @@ class Network {
     return loss;
   }
 
+  /**
+   * Inference only copy with every Linear layer replaced by a
+   * QuantizedLinear of bits, 8 or 16, calibrated on the inputs it gets for
+   * calibration, a batch of network inputs.
+   */
+  Network Quantize(FloatTensor const& calibration, u_int bits = 8u) const {
+    std::vector<std::unique_ptr<ILayer>> layers;
+    FloatTensor current = calibration;
+
+    for (auto const& l : layers_) {
+      if (auto const* linear = dynamic_cast<Linear const*>(l.get())) {
+        if (bits == 16u) {
+          layers.emplace_back(
+              std::make_unique<QuantizedLinear<int16_t>>(*linear, current));
+        } else {
+          layers.emplace_back(
+              std::make_unique<QuantizedLinear<int8_t>>(*linear, current));
+        }
+      } else {
+        std::stringstream copy;
+        l->Serialize(copy);
+        layers.emplace_back(ReadLayer(copy));
+      }
+      current = const_cast<ILayer const*>(l.get())->Forward(std::move(current));
+    }
+
+    return Network(std::move(layers), std::make_unique<MeanSquareError>());
+  }
+
+  std::vector<std::unique_ptr<ILayer>> const& layers() const {
+    return layers_;
+  }
+
   void SaveToFile(std::string const& fname) const {
     std::ofstream out;
     out.open(fname);
@@ -108,6 +144,8 @@ class Network {
       return ReLU::Deserialize(in);
     } else if (byte == 'T') {
       return TanHActivation::Deserialize(in);
+    } else if (byte == 'Q') {
+      return ReadQuantizedLinear(in);
     } else {
       ASSERT(false);
       return nullptr;
@@ -0,0 +1,346 @@
+#ifndef __INCLUDE_GUARD_NEURAL_QUANTIZED_LINEAR
+#define __INCLUDE_GUARD_NEURAL_QUANTIZED_LINEAR
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "neural_ILayer.hpp"
+#include "neural_Linear.hpp"
+#include "neural_Matrix.hpp"
+
+namespace neural {
+
+/**
+ * Inference only Linear layer with int8 or int16 weights and activations.
+ *
+ * Each input i is quantized to q = round(x / input_scale[i]) + input_zero[i]
+ * in [0, kMaxInput] over the range a calibration found for it, input_zero
+ * being 0 for non negative inputs (after a ReLU) and kSignedZero otherwise.
+ * The input scales are folded into the weights, quantized to [-kMaxWeight,
+ * kMaxWeight] with one scale per output, and the zero points into the int32
+ * biases. An output is then the int32 dot product of the quantized input
+ * and weights plus the bias, times the output's weight scale.
+ *
+ * int8 inputs keep to 7 bits so pmaddubsw sums pairs of products in int16
+ * without saturating. int16 ones multiply with pmaddwd, their 11 bit inputs
+ * and 12 bit weights keep sums of up to 255 products in int32.
+ */
+template <class Weight>
+class QuantizedLinear : public ILayer {
+ public:
+  static_assert(std::is_same_v<Weight, int8_t> ||
+                std::is_same_v<Weight, int16_t>);
+
+  static bool constexpr kInt8 = std::is_same_v<Weight, int8_t>;
+  using Input = std::conditional_t<kInt8, uint8_t, int16_t>;
+
+  static char constexpr kBits = 8 * sizeof(Weight);
+  static int32_t constexpr kMaxInput = kInt8 ? 127 : 2047;
+  static int32_t constexpr kSignedZero = (kMaxInput + 1) / 2;
+  static int32_t constexpr kMaxWeight = kInt8 ? 127 : 4095;
+
+  /**
+   * Quantization of linear for the range of inputs, a batch of calibration
+   * inputs to it.
+   */
+  QuantizedLinear(Linear const& linear, FloatTensor const& inputs) {
+    ASSERT(inputs.shape()[1] == linear.w().shape()[0]);
+
+    u_int n_input = linear.w().shape()[0];
+    u_int n_output = linear.w().shape()[1];
+    Matrix<float> input_scales(1u, n_input);
+    Matrix<int32_t> input_zeros(1u, n_input);
+    for (u_int i = 0u; i < n_input; ++i) {
+      float min = 0.0f;
+      float max = 0.0f;
+      for (u_int r = 0u; r < inputs.shape()[0]; ++r) {
+        min = std::min(min, inputs.Get(r, i));
+        max = std::max(max, inputs.Get(r, i));
+      }
+
+      float scale = max / kMaxInput;
+      if (min < 0.0f) {
+        input_zeros.Get(i) = kSignedZero;
+        scale = std::max(-min / kSignedZero, max / (kMaxInput - kSignedZero));
+      }
+      input_scales.Get(i) = std::max(scale, kMinScale);
+    }
+
+    Matrix<float> weight_scales(1u, n_output);
+    Matrix<Weight> w(n_output, n_input);
+    Matrix<int32_t> b(1u, n_output);
+    for (u_int j = 0u; j < n_output; ++j) {
+      float max_weight = 0.0f;
+      for (u_int i = 0u; i < n_input; ++i) {
+        max_weight = std::max(
+            max_weight, std::abs(linear.w().Get(i, j) * input_scales.Get(i)));
+      }
+      float scale = std::max(max_weight / kMaxWeight, kMinScale);
+      weight_scales.Get(j) = scale;
+
+      int32_t zero_sum = 0;
+      for (u_int i = 0u; i < n_input; ++i) {
+        auto q = static_cast<Weight>(
+            std::lrint(linear.w().Get(i, j) * input_scales.Get(i) / scale));
+        w.Get(j, i) = q;
+        zero_sum += q * input_zeros.Get(i);
+      }
+      b.Get(j) =
+          static_cast<int32_t>(std::lrint(linear.b().Get(j) / scale)) -
+          zero_sum;
+    }
+    SetWeights(input_scales, input_zeros, weight_scales, w, b);
+  }
+
+  QuantizedLinear(Matrix<float> const& input_scales,
+                  Matrix<int32_t> const& input_zeros,
+                  Matrix<float> const& weight_scales, Matrix<Weight> const& w,
+                  Matrix<int32_t> const& b) {
+    SetWeights(input_scales, input_zeros, weight_scales, w, b);
+  }
+
+  FloatTensor Forward(FloatTensor const& input) override {
+    return const_cast<QuantizedLinear const*>(this)->Forward(
+        FloatTensor(input));
+  }
+
+  FloatTensor Forward(FloatTensor&& input) const override {
+    ASSERT(input.shape()[1] == n_input_);
+
+    FloatTensor result(input.shape()[0], n_output_);
+    static thread_local std::vector<Input> row;
+    row.assign(stride_, 0u);
+    for (u_int r = 0u; r < input.shape()[0]; ++r) {
+      Quantize(input.data() + r * n_input_, row.data());
+      float* output = result.data() + r * n_output_;
+      u_int j = 0u;
+#ifdef __AVX2__
+      for (; j + 4u <= n_output_; j += 4u) {
+        __m128 sums = _mm_cvtepi32_ps(_mm_add_epi32(
+            Dot4(row.data(), w_.data() + j * stride_),
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(b_.data() + j))));
+        __m128 scales = _mm_loadu_ps(weight_scales_.data() + j);
+        _mm_storeu_ps(output + j, _mm_mul_ps(sums, scales));
+      }
+#endif
+      for (; j < n_output_; ++j) {
+        int32_t sum = Dot(row.data(), w_.data() + j * stride_) + b_[j];
+        output[j] = sum * weight_scales_[j];
+      }
+    }
+    return result;
+  }
+
+  FloatTensor Backwards(FloatTensor const& output_gradient,
+                        float learn_rate) override {
+    throw std::logic_error("QuantizedLinear is inference only");
+  }
+
+  void Serialize(std::ostream& out) const override {
+    char byte = 'Q';
+    out.write(&byte, 1);
+    out.write(&kBits, 1);
+
+    Matrix<float> input_scales(1u, n_input_);
+    Matrix<int32_t> input_zeros(1u, n_input_);
+    for (u_int i = 0u; i < n_input_; ++i) {
+      input_scales.Get(i) = input_scales_[i];
+      input_zeros.Get(i) = input_zeros_[i];
+    }
+    Matrix<float> weight_scales(1u, n_output_);
+    Matrix<Weight> w(n_output_, n_input_);
+    Matrix<int32_t> b(1u, n_output_);
+    for (u_int j = 0u; j < n_output_; ++j) {
+      weight_scales.Get(j) = weight_scales_[j];
+      std::copy_n(w_.data() + j * stride_, n_input_, w.data() + j * n_input_);
+      b.Get(j) = b_[j];
+    }
+
+    input_scales.Serialize(out);
+    input_zeros.Serialize(out);
+    weight_scales.Serialize(out);
+    w.Serialize(out);
+    b.Serialize(out);
+  }
+
+  /**
+   * Reads a layer Serialize wrote, after its tag and bits.
+   */
+  static std::unique_ptr<QuantizedLinear> Deserialize(std::istream& in) {
+    auto input_scales = Matrix<float>::Deserialize(in);
+    auto input_zeros = Matrix<int32_t>::Deserialize(in);
+    auto weight_scales = Matrix<float>::Deserialize(in);
+    auto w = Matrix<Weight>::Deserialize(in);
+    auto b = Matrix<int32_t>::Deserialize(in);
+    return std::make_unique<QuantizedLinear>(input_scales, input_zeros,
+                                             weight_scales, w, b);
+  }
+
+ private:
+  static float constexpr kMinScale = 1e-8f;
+  /* Inputs one AVX2 multiply consumes. */
+  static u_int constexpr kBlock = 32u / sizeof(Weight);
+
+  /**
+   * Weights as output major rows padded with zeros to stride_.
+   */
+  void SetWeights(Matrix<float> const& input_scales,
+                  Matrix<int32_t> const& input_zeros,
+                  Matrix<float> const& weight_scales, Matrix<Weight> const& w,
+                  Matrix<int32_t> const& b) {
+    n_output_ = w.shape()[0];
+    n_input_ = w.shape()[1];
+    stride_ = (n_input_ + kBlock - 1u) / kBlock * kBlock;
+
+    input_scales_.assign(input_scales.data(), input_scales.data() + n_input_);
+    input_inverse_scales_.resize(n_input_);
+    for (u_int i = 0u; i < n_input_; ++i) {
+      input_inverse_scales_[i] = 1.0f / input_scales_[i];
+    }
+    input_zeros_.assign(input_zeros.data(), input_zeros.data() + n_input_);
+    weight_scales_.assign(weight_scales.data(),
+                          weight_scales.data() + n_output_);
+
+    w_.assign(n_output_ * stride_, 0);
+    for (u_int j = 0u; j < n_output_; ++j) {
+      std::copy_n(w.data() + j * n_input_, n_input_, w_.data() + j * stride_);
+    }
+    b_.assign(b.data(), b.data() + n_output_);
+  }
+
+  void Quantize(float const* input, Input* row) const {
+    u_int i = 0u;
+#ifdef __AVX2__
+    __m256i max = _mm256_set1_epi32(kMaxInput);
+    for (; i + 8u <= n_input_; i += 8u) {
+      __m256 x =
+          _mm256_mul_ps(_mm256_loadu_ps(input + i),
+                        _mm256_loadu_ps(input_inverse_scales_.data() + i));
+      __m256i q = _mm256_add_epi32(
+          _mm256_cvtps_epi32(x),
+          _mm256_loadu_si256(
+              reinterpret_cast<__m256i const*>(input_zeros_.data() + i)));
+      q = _mm256_min_epi32(_mm256_max_epi32(q, _mm256_setzero_si256()), max);
+      /* Packing works within 128 bit lanes, the permute joins the halves. */
+      __m128i q16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(
+          _mm256_packs_epi32(q, q), _MM_SHUFFLE(3, 1, 2, 0)));
+      if constexpr (kInt8) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(row + i),
+                         _mm_packus_epi16(q16, q16));
+      } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), q16);
+      }
+    }
+#endif
+    for (; i < n_input_; ++i) {
+      float x = input[i] * input_inverse_scales_[i];
+      int32_t q = static_cast<int32_t>(std::lrint(x)) + input_zeros_[i];
+      row[i] = static_cast<Input>(std::clamp(q, 0, kMaxInput));
+    }
+  }
+
+#ifdef __AVX2__
+  /**
+   * Products of one AVX2 block of inputs and weights, summed in int32 lanes.
+   */
+  static __m256i Multiply(__m256i x, __m256i w) {
+    if constexpr (kInt8) {
+      return _mm256_madd_epi16(_mm256_maddubs_epi16(x, w),
+                               _mm256_set1_epi16(1));
+    } else {
+      return _mm256_madd_epi16(x, w);
+    }
+  }
+
+  /**
+   * Dot products of the input with four consecutive weight rows, reduced
+   * together.
+   */
+  __m128i Dot4(Input const* input, Weight const* weights) const {
+    __m256i acc[4];
+    for (u_int k = 0u; k < 4u; ++k) {
+      acc[k] = _mm256_setzero_si256();
+    }
+    for (u_int i = 0u; i < stride_; i += kBlock) {
+      __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+      for (u_int k = 0u; k < 4u; ++k) {
+        __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(weights + k * stride_ + i));
+        acc[k] = _mm256_add_epi32(acc[k], Multiply(x, w));
+      }
+    }
+    __m256i sums = _mm256_hadd_epi32(_mm256_hadd_epi32(acc[0], acc[1]),
+                                     _mm256_hadd_epi32(acc[2], acc[3]));
+    return _mm_add_epi32(_mm256_castsi256_si128(sums),
+                         _mm256_extracti128_si256(sums, 1));
+  }
+#endif
+
+  /**
+   * Dot product of stride_ quantized inputs and weights.
+   */
+  int32_t Dot(Input const* input, Weight const* weights) const {
+#ifdef __AVX2__
+    __m256i acc = _mm256_setzero_si256();
+    for (u_int i = 0u; i < stride_; i += kBlock) {
+      __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+      __m256i w =
+          _mm256_loadu_si256(reinterpret_cast<__m256i const*>(weights + i));
+      acc = _mm256_add_epi32(acc, Multiply(x, w));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (u_int i = 0u; i < stride_; ++i) {
+      sum += static_cast<int32_t>(input[i]) * weights[i];
+    }
+    return sum;
+#endif
+  }
+
+  u_int n_input_;
+  u_int n_output_;
+  u_int stride_;
+  std::vector<float> input_scales_;
+  std::vector<float> input_inverse_scales_;
+  std::vector<int32_t> input_zeros_;
+  std::vector<float> weight_scales_;
+  std::vector<Weight> w_;
+  std::vector<int32_t> b_;
+};
+
+/**
+ * Reads a QuantizedLinear of either width, after its tag.
+ */
+inline std::unique_ptr<ILayer> ReadQuantizedLinear(std::istream& in) {
+  char bits;
+  in.read(&bits, 1);
+
+  if (bits == QuantizedLinear<int8_t>::kBits) {
+    return QuantizedLinear<int8_t>::Deserialize(in);
+  } else if (bits == QuantizedLinear<int16_t>::kBits) {
+    return QuantizedLinear<int16_t>::Deserialize(in);
+  } else {
+    ASSERT(false);
+    return nullptr;
+  }
+}
+
+}  // namespace neural
+
+#endif
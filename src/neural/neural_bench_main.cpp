@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "neural_FrozenNetwork.hpp"
+#include "neural_Matrix.hpp"
+#include "util_TimeStamp.hpp"
+
+/**
+ * Matrix product benchmark.
+ *
+ * Times the three products of a Linear layer, forward (MatMul), input
+ * gradient (MatMulNT) and weight gradient (MatMulTN), on the NeuralHeuristic
+ * layer shapes at the batch sizes of main.cpp and train_network_main.cpp.
+ * Each is compared to the previous triple loop, which took explicit
+ * transposes for the gradients.
+ *
+ * Then times one position through the whole NeuralHeuristic network,
+ * FrozenNetwork against Network::Forward, and a batch of positions through
+ * its 8 and 16 bit quantizations against the float network.
+ *
+ * Usage: bench_neural.exe [--seconds 0.2]
+ * Exit code 1 if a product differs from the triple loop.
+ */
+
+namespace {
+
+using neural::FloatTensor;
+using util::TimeStamp;
+
+static std::vector<u_int> const BATCH_SIZES = {1u, 128u, 2048u};
+
+/* Input and output dimensions of the NeuralHeuristic layers. */
+static std::vector<std::array<u_int, 2>> const LAYERS = {
+    {118u, 32u}, {32u, 24u}, {24u, 16u}, {16u, 1u}};
+
+static float constexpr TOLERANCE = 1e-4f;
+
+static u_int constexpr QUANTIZED_BATCH_SIZE = 128u;
+
+FloatTensor NaiveMatMul(FloatTensor const& left, FloatTensor const& right) {
+  FloatTensor result(left.shape()[0], right.shape()[1]);
+
+  for (u_int r_c = 0u; r_c < right.shape()[1]; ++r_c) {
+    for (u_int l_r = 0u; l_r < left.shape()[0]; ++l_r) {
+      for (u_int l_c = 0u; l_c < left.shape()[1]; ++l_c) {
+        result.Get(l_r, r_c) += left.Get(l_r, l_c) * right.Get(l_c, r_c);
+      }
+    }
+  }
+
+  return result;
+}
+
+FloatTensor RandomTensor(u_int rows, u_int cols, std::mt19937& rand_engine) {
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  FloatTensor t(rows, cols);
+  t.Randomize([&] { return dist(rand_engine); });
+  return t;
+}
+
+float Value(FloatTensor const& t) { return t.Get(0u); }
+float Value(float v) { return v; }
+
+float MaxDifference(FloatTensor const& left, FloatTensor const& right) {
+  float max = 0.0f;
+  for (u_int i = 0u; i < left.size(); ++i) {
+    max = std::max(max, std::abs(left.Get(i) - right.Get(i)));
+  }
+  return max;
+}
+
+/**
+ * Seconds per call of product, repeated for at least min_seconds.
+ */
+template <class Product>
+double Time(Product&& product, double min_seconds) {
+  size_t n = 0u;
+  float sink = 0.0f;
+  TimeStamp start;
+  do {
+    sink += Value(product());
+    ++n;
+  } while (start.Since() < min_seconds);
+  double seconds = start.Since() / n;
+
+  /* Keeps the products from being optimized out. */
+  if (sink == 12345.0f) {
+    std::printf(" ");
+  }
+  return seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double min_seconds = 0.2;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--seconds") == 0) {
+      min_seconds = std::stod(argv[i + 1]);
+    } else {
+      std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rand_engine(1u);
+  bool ok = true;
+  bool first = true;
+  std::printf("{\n  \"benchmarks\": [");
+  for (u_int batch : BATCH_SIZES) {
+    for (auto const& layer : LAYERS) {
+      auto input = RandomTensor(batch, layer[0], rand_engine);
+      auto w = RandomTensor(layer[0], layer[1], rand_engine);
+      auto gradient = RandomTensor(batch, layer[1], rand_engine);
+
+      struct Case {
+        char const* name;
+        FloatTensor expected;
+        FloatTensor actual;
+        double naive;
+        double blocked;
+      };
+      std::vector<Case> cases;
+      cases.push_back(Case{
+          "forward", NaiveMatMul(input, w), neural::MatMul(input, w),
+          Time([&] { return NaiveMatMul(input, w); }, min_seconds),
+          Time([&] { return neural::MatMul(input, w); }, min_seconds)});
+      cases.push_back(Case{
+          "input_gradient", NaiveMatMul(gradient, w.transpose()),
+          neural::MatMulNT(gradient, w),
+          Time([&] { return NaiveMatMul(gradient, w.transpose()); },
+               min_seconds),
+          Time([&] { return neural::MatMulNT(gradient, w); }, min_seconds)});
+      cases.push_back(Case{
+          "weight_gradient", NaiveMatMul(input.transpose(), gradient),
+          neural::MatMulTN(input, gradient),
+          Time([&] { return NaiveMatMul(input.transpose(), gradient); },
+               min_seconds),
+          Time([&] { return neural::MatMulTN(input, gradient); },
+               min_seconds)});
+
+      for (auto const& c : cases) {
+        float difference = MaxDifference(c.expected, c.actual);
+        if (difference > TOLERANCE) {
+          std::fprintf(stderr, "%s %ux%ux%u: differs by %g\n", c.name, batch,
+                       layer[0], layer[1], difference);
+          ok = false;
+        }
+
+        double n_flops = 2.0 * batch * layer[0] * layer[1];
+        std::printf(
+            "%s\n    {\"name\": \"%s_%u_%ux%u\", \"naive_seconds\": %.9f, "
+            "\"seconds\": %.9f, \"gflops\": %.3f, \"speedup\": %.2f}",
+            first ? "" : ",", c.name, batch, layer[0], layer[1], c.naive,
+            c.blocked, n_flops / c.blocked * 1e-9, c.naive / c.blocked);
+        first = false;
+      }
+      std::fflush(stdout);
+    }
+  }
+  std::printf("\n  ],\n");
+
+  std::vector<std::unique_ptr<neural::ILayer>> layers;
+  for (size_t l = 0u; l < LAYERS.size(); ++l) {
+    if (l > 0u) {
+      layers.emplace_back(std::make_unique<neural::ReLU>());
+    }
+    layers.emplace_back(
+        std::make_unique<neural::Linear>(LAYERS[l][0], LAYERS[l][1]));
+  }
+  neural::Network const network(std::move(layers),
+                                std::make_unique<neural::MeanSquareError>());
+  neural::FrozenNetwork<118u, 32u, 24u, 16u, 1u> frozen(network);
+  auto input = RandomTensor(1u, 118u, rand_engine);
+
+  float expected = network.Forward(FloatTensor(input)).value();
+  float actual = frozen.Forward(input.data());
+  if (std::abs(expected - actual) > TOLERANCE) {
+    std::fprintf(stderr, "frozen network: differs by %g\n",
+                 std::abs(expected - actual));
+    ok = false;
+  }
+  double network_seconds = Time(
+      [&] { return network.Forward(FloatTensor(input)); }, min_seconds);
+  double frozen_seconds =
+      Time([&] { return frozen.Forward(input.data()); }, min_seconds);
+  std::printf(
+      "  \"network\": {\"naive_seconds\": %.9f, \"seconds\": %.9f, "
+      "\"speedup\": %.2f},\n",
+      network_seconds, frozen_seconds, network_seconds / frozen_seconds);
+
+  auto batch = RandomTensor(QUANTIZED_BATCH_SIZE, 118u, rand_engine);
+  double float_seconds =
+      Time([&] { return network.Forward(FloatTensor(batch)); }, min_seconds);
+  std::printf("  \"quantized\": [");
+  for (u_int bits : {8u, 16u}) {
+    neural::Network const quantized = network.Quantize(batch, bits);
+    double seconds = Time(
+        [&] { return quantized.Forward(FloatTensor(batch)); }, min_seconds);
+    std::printf(
+        "%s\n    {\"bits\": %u, \"batch\": %u, \"float_seconds\": %.9f, "
+        "\"seconds\": %.9f, \"speedup\": %.2f}",
+        bits == 8u ? "" : ",", bits, QUANTIZED_BATCH_SIZE, float_seconds,
+        seconds, float_seconds / seconds);
+  }
+  std::printf("\n  ]\n}\n");
+
+  return ok ? 0 : 1;
+}
@@ -4,6 +4,11 @@
 #include <cfloat>
 #include <chrono>
 #include <cmath>
+#include <type_traits>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 namespace util {
 
@@ -14,6 +19,20 @@ inline u_int popcnt(uint64_t v) {
   return static_cast<u_int>(__builtin_popcountll(v));
 }
 
+/**
+ * Index of the n-th (0 based) set bit of v, v must have more than n bits set.
+ */
+inline u_int SelectBit(uint64_t v, u_int n) {
+#ifdef __BMI2__
+  return static_cast<u_int>(__builtin_ctzll(_pdep_u64(1ull << n, v)));
+#else
+  while (n-- > 0) {
+    v &= v - 1;
+  }
+  return static_cast<u_int>(__builtin_ctzll(v));
+#endif
+}
+
 static bool constexpr ENABLE_ASSERTS = false;
 
 template <class It, class Evaluate>
@@ -32,6 +51,40 @@ It MaxElement(It begin, It end, Evaluate&& evaluate) {
   return best;
 }
 
+/**
+ * Relaxed atomic access to plain fields, for statistics shared between
+ * search threads that must stay copyable.
+ */
+template <class T>
+T AtomicLoad(T const& v) {
+  T value;
+  __atomic_load(&v, &value, __ATOMIC_RELAXED);
+  return value;
+}
+
+template <class T>
+void AtomicStore(T& v, T value) {
+  __atomic_store(&v, &value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Adds d to v and returns the previous value.
+ */
+template <class T>
+T AtomicAdd(T& v, T d) {
+  if constexpr (std::is_floating_point_v<T>) {
+    T expected = AtomicLoad(v);
+    T desired;
+    do {
+      desired = expected + d;
+    } while (!__atomic_compare_exchange(&v, &expected, &desired, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return expected;
+  } else {
+    return __atomic_fetch_add(&v, d, __ATOMIC_RELAXED);
+  }
+}
+
 }  // namespace util
 
 #define __stringize(a) #a
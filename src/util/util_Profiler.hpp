@@ -0,0 +1,81 @@
+#ifndef __INCLUDE_GUARD_UTIL_PROFILER_HPP
+#define __INCLUDE_GUARD_UTIL_PROFILER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "util_General.hpp"
+
+namespace util {
+
+/* Compiles Profiler and ScopedTimer in, they do nothing otherwise. */
+static bool constexpr ENABLE_PROFILING = false;
+
+/**
+ * Time stamp counter, a steady clock in nanoseconds where there is none.
+ */
+inline uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/**
+ * Cycles spent in kSections code sections, summed over every thread timing
+ * them since the last Reset.
+ */
+template <size_t kSections>
+class Profiler {
+ public:
+  void Add(size_t section, uint64_t cycles) {
+    if constexpr (ENABLE_PROFILING) {
+      AtomicAdd(cycles_[section], cycles);
+    }
+  }
+
+  uint64_t Get(size_t section) const { return cycles_[section]; }
+
+  void Reset() { cycles_.fill(0u); }
+
+ private:
+  std::array<uint64_t, kSections> cycles_{};
+};
+
+/**
+ * Adds the cycles from construction to destruction to a Profiler section.
+ */
+template <class Profiler>
+class ScopedTimer {
+ public:
+  ScopedTimer(Profiler& profiler, size_t section)
+      : profiler_(profiler), section_(section) {
+    if constexpr (ENABLE_PROFILING) {
+      start_ = ReadCycles();
+    }
+  }
+
+  ~ScopedTimer() {
+    if constexpr (ENABLE_PROFILING) {
+      profiler_.Add(section_, ReadCycles() - start_);
+    }
+  }
+
+  ScopedTimer(ScopedTimer const&) = delete;
+  ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+ private:
+  Profiler& profiler_;
+  size_t section_;
+  uint64_t start_{};
+};
+
+}  // namespace util
+
+#endif /* __INCLUDE_GUARD_UTIL_PROFILER_HPP */